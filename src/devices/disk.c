@@ -1,15 +1,39 @@
 #include "devices/disk.h"
 #include <ctype.h>
 #include <debug.h>
+#include <round.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include "devices/timer.h"
 #include "threads/io.h"
 #include "threads/interrupt.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
 
 /* The code in this file is an interface to an ATA (IDE)
-   controller.  It attempts to comply to [ATA-3]. */
+   controller.  It attempts to comply to [ATA-3].
+
+   If a PCI IDE controller capable of bus mastering is present,
+   as with the PIIX emulated by QEMU, transfers are done by DMA
+   [SFF-8038i].  Otherwise, and for disks that do not support
+   DMA, data is moved by programmed I/O, with READ MULTIPLE and
+   WRITE MULTIPLE if the disk supports them so that the CPU is
+   interrupted once per block of sectors rather than once per
+   sector.  Either way, a run of consecutive sectors is moved
+   with a single command.
+
+   Each channel has a queue of requests and a dispatcher thread
+   that serves it.  The dispatcher picks requests in C-LOOK
+   order, sweeping up through the sectors and then jumping back
+   to the lowest pending one, and merges queued requests for
+   sectors adjacent to the chosen one into the same command.  A
+   request's submitter may go on with other work until it needs
+   the result.  The channels are independent, so each of them
+   can have a command in flight at the same time, e.g. a swap
+   write on one channel and a file read on the other.  A DMA
+   command's requests are completed directly by the interrupt
+   handler. */
 
 /* ATA command block port addresses. */
 #define reg_data(CHANNEL) ((CHANNEL)->reg_base + 0)     /* Data. */
@@ -28,10 +52,25 @@
 #define reg_ctl(CHANNEL) ((CHANNEL)->reg_base + 0x206)  /* Control (w/o). */
 #define reg_alt_status(CHANNEL) reg_ctl (CHANNEL)       /* Alt Status (r/o). */
 
+/* Bus master IDE port addresses. */
+#define reg_bm_command(CHANNEL) ((CHANNEL)->bm_base + 0) /* Command. */
+#define reg_bm_status(CHANNEL) ((CHANNEL)->bm_base + 2)  /* Status. */
+#define reg_bm_prdt(CHANNEL) ((CHANNEL)->bm_base + 4)    /* PRD table. */
+
 /* Alternate Status Register bits. */
 #define STA_BSY 0x80            /* Busy. */
 #define STA_DRDY 0x40           /* Device Ready. */
 #define STA_DRQ 0x08            /* Data Request. */
+#define STA_ERR 0x01            /* Error. */
+
+/* Bus Master Command Register bits. */
+#define BM_START 0x01           /* Start transfer. */
+#define BM_READ 0x08            /* Transfer from disk to memory. */
+
+/* Bus Master Status Register bits. */
+#define BM_ACTIVE 0x01          /* Transfer in progress. */
+#define BM_ERROR 0x02           /* Transfer failed (write 1 to clear). */
+#define BM_INTR 0x04            /* Interrupt raised (write 1 to clear). */
 
 /* Control Register bits. */
 #define CTL_SRST 0x04           /* Software Reset. */
@@ -47,6 +86,38 @@
 #define CMD_IDENTIFY_DEVICE 0xec        /* IDENTIFY DEVICE. */
 #define CMD_READ_SECTOR_RETRY 0x20      /* READ SECTOR with retries. */
 #define CMD_WRITE_SECTOR_RETRY 0x30     /* WRITE SECTOR with retries. */
+#define CMD_READ_MULTIPLE 0xc4          /* READ MULTIPLE. */
+#define CMD_WRITE_MULTIPLE 0xc5         /* WRITE MULTIPLE. */
+#define CMD_SET_MULTIPLE_MODE 0xc6      /* SET MULTIPLE MODE. */
+#define CMD_READ_DMA 0xc8               /* READ DMA. */
+#define CMD_WRITE_DMA 0xca              /* WRITE DMA. */
+
+/* Maximum number of sectors moved by one PIO command. */
+#define PIO_MAX_SECTORS 256
+
+/* Maximum number of sectors moved by one DMA command, and
+   number of entries in a PRD table.  A transfer needs at most
+   one PRD per page it touches, that is, 9 for 64 sectors.
+   PRD_CNT is a power of 2 so that PRD tables may be aligned on
+   their size. */
+#define DMA_MAX_SECTORS 64
+#define PRD_CNT 16
+
+/* A physical region descriptor, which tells the bus master
+   where one physically contiguous piece of a DMA buffer is.  A
+   PRD table is an array of these, ending with one whose FLAGS
+   has PRD_EOT set. */
+struct prd
+  {
+    uint32_t addr;              /* Physical address. */
+    uint16_t size;              /* Size in bytes; 0 means 64 kB. */
+    uint16_t flags;             /* PRD_EOT or 0. */
+  };
+#define PRD_EOT 0x8000          /* Last PRD in the table. */
+
+/* PCI configuration space ports. */
+#define PCI_CONFIG_ADDR 0xcf8   /* Configuration address. */
+#define PCI_CONFIG_DATA 0xcfc   /* Configuration data. */
 
 /* An ATA device. */
 struct disk 
@@ -57,9 +128,14 @@ struct disk
 
     bool is_ata;                /* 1=This device is an ATA disk. */
     disk_sector_t capacity;     /* Capacity in sectors (if is_ata). */
+    bool use_dma;               /* Transfer by DMA instead of PIO? */
+    int multiple_cnt;           /* Sectors per PIO block, 1 if no
+                                   READ/WRITE MULTIPLE support. */
 
     long long read_cnt;         /* Number of sectors read. */
     long long write_cnt;        /* Number of sectors written. */
+    long long command_cnt;      /* Number of read/write commands. */
+    long long request_cnt;      /* Number of requests served. */
   };
 
 /* An ATA channel (aka controller).
@@ -70,11 +146,25 @@ struct channel
     uint16_t reg_base;          /* Base I/O port. */
     uint8_t irq;                /* Interrupt in use. */
 
-    struct lock lock;           /* Must acquire to access the controller. */
+    struct lock lock;           /* Protects QUEUE and HEAD. */
+    struct list queue;          /* Pending requests. */
+    struct condition queue_ready;       /* Signaled when QUEUE grows. */
+    uint32_t head;              /* Position reached by the C-LOOK sweep. */
+
     bool expecting_interrupt;   /* True if an interrupt is expected, false if
                                    any interrupt would be spurious. */
     struct semaphore completion_wait;   /* Up'd by interrupt handler. */
 
+    uint16_t bm_base;           /* Bus master base I/O port, 0 if none. */
+    struct prd *prdt;           /* PRD table for DMA transfers. */
+    struct list *dma_batch;     /* Requests of DMA command in flight. */
+    uint8_t bm_status;          /* Bus master status at last interrupt. */
+    uint8_t status;             /* Status at last interrupt. */
+
+    bool busy;                  /* Dispatcher serving requests? */
+    int64_t busy_since;         /* Start of current busy period. */
+    int64_t busy_ticks;         /* Length of earlier busy periods. */
+
     struct disk devices[2];     /* The devices on this channel. */
   };
 
@@ -82,14 +172,33 @@ struct channel
 #define CHANNEL_CNT 2
 static struct channel channels[CHANNEL_CNT];
 
+/* PRD tables, one per channel.  A PRD table must not cross a
+   64 kB boundary, which aligning each to its own size ensures. */
+static struct prd prd_tables[CHANNEL_CNT][PRD_CNT]
+  __attribute__ ((aligned (sizeof (struct prd[PRD_CNT]))));
+
+/* Timer ticks at disk_init(). */
+static int64_t init_ticks;
+
 static void reset_channel (struct channel *);
 static bool check_device_type (struct disk *);
 static void identify_ata_device (struct disk *);
-
-static void select_sector (struct disk *, disk_sector_t);
-static void issue_pio_command (struct channel *, uint8_t command);
+static uint16_t find_bus_master (void);
+
+static void request_and_wait (struct disk *, disk_sector_t, size_t cnt,
+                              void *buffer, bool write);
+static void dispatcher (void *channel);
+static struct disk_request *next_request (struct channel *,
+                                          struct list *batch);
+static void transfer (struct list *batch);
+static void select_sector (struct disk *, disk_sector_t, size_t cnt);
+static void issue_command (struct channel *, uint8_t command);
 static void input_sector (struct channel *, void *);
 static void output_sector (struct channel *, const void *);
+static bool pio_transfer (struct disk *, disk_sector_t, size_t cnt,
+                          struct list *batch, bool write);
+static bool dma_transfer (struct disk *, disk_sector_t, size_t cnt,
+                          struct list *batch, bool write);
 
 static void wait_until_idle (const struct disk *);
 static bool wait_while_busy (const struct disk *);
@@ -102,8 +211,11 @@ static void interrupt_handler (struct intr_frame *);
 void
 disk_init (void) 
 {
+  uint16_t bm_base = find_bus_master ();
   size_t chan_no;
 
+  init_ticks = timer_ticks ();
+
   for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++)
     {
       struct channel *c = &channels[chan_no];
@@ -125,8 +237,17 @@ disk_init (void)
           NOT_REACHED ();
         }
       lock_init (&c->lock);
+      list_init (&c->queue);
+      cond_init (&c->queue_ready);
+      c->head = 0;
       c->expecting_interrupt = false;
       sema_init (&c->completion_wait, 0);
+      c->bm_base = bm_base != 0 ? bm_base + 8 * chan_no : 0;
+      c->prdt = prd_tables[chan_no];
+      c->dma_batch = NULL;
+      c->bm_status = c->status = 0;
+      c->busy = false;
+      c->busy_ticks = 0;
  
       /* Initialize devices. */
       for (dev_no = 0; dev_no < 2; dev_no++)
@@ -138,8 +259,11 @@ disk_init (void)
 
           d->is_ata = false;
           d->capacity = 0;
+          d->use_dma = false;
+          d->multiple_cnt = 1;
 
           d->read_cnt = d->write_cnt = 0;
+          d->command_cnt = d->request_cnt = 0;
         }
 
       /* Register interrupt handler. */
@@ -156,6 +280,10 @@ disk_init (void)
       for (dev_no = 0; dev_no < 2; dev_no++)
         if (c->devices[dev_no].is_ata)
           identify_ata_device (&c->devices[dev_no]);
+
+      /* From now on, only the dispatcher touches the hardware. */
+      if (c->devices[0].is_ata || c->devices[1].is_ata)
+        thread_create (c->name, PRI_DEFAULT, dispatcher, c);
     }
 }
 
@@ -163,18 +291,38 @@ disk_init (void)
 void
 disk_print_stats (void) 
 {
+  int64_t elapsed = timer_elapsed (init_ticks);
   int chan_no;
 
   for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++) 
     {
+      struct channel *c = &channels[chan_no];
+      enum intr_level old_level;
+      int64_t busy_ticks;
       int dev_no;
 
+      if (!c->devices[0].is_ata && !c->devices[1].is_ata)
+        continue;
+
+      old_level = intr_disable ();
+      busy_ticks = c->busy_ticks;
+      if (c->busy)
+        busy_ticks += timer_elapsed (c->busy_since);
+      intr_set_level (old_level);
+      printf ("%s: busy %lld of %lld ticks (%lld%%)\n", c->name,
+              busy_ticks, elapsed,
+              elapsed > 0 ? busy_ticks * 100 / elapsed : 0);
+
       for (dev_no = 0; dev_no < 2; dev_no++) 
         {
           struct disk *d = disk_get (chan_no, dev_no);
           if (d != NULL && d->is_ata) 
-            printf ("%s: %lld reads, %lld writes\n",
-                    d->name, d->read_cnt, d->write_cnt);
+            printf ("%s: %lld reads, %lld writes, %lld requests, "
+                    "%lld commands, %lld bytes (%s)\n",
+                    d->name, d->read_cnt, d->write_cnt, d->request_cnt,
+                    d->command_cnt,
+                    (d->read_cnt + d->write_cnt) * DISK_SECTOR_SIZE,
+                    d->use_dma ? "DMA" : "PIO");
         }
     }
 }
@@ -186,7 +334,7 @@ disk_print_stats (void)
         0:0 - boot loader, command line args, and operating system kernel
         0:1 - file system
         1:0 - scratch
-        1:1 - swap
+        1:1 - swap (unless moved with -swap)
 */
 struct disk *
 disk_get (int chan_no, int dev_no) 
@@ -219,21 +367,7 @@ disk_size (struct disk *d)
 void
 disk_read (struct disk *d, disk_sector_t sec_no, void *buffer) 
 {
-  struct channel *c;
-  
-  ASSERT (d != NULL);
-  ASSERT (buffer != NULL);
-
-  c = d->channel;
-  lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_READ_SECTOR_RETRY);
-  sema_down (&c->completion_wait);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no);
-  input_sector (c, buffer);
-  d->read_cnt++;
-  lock_release (&c->lock);
+  disk_read_multiple (d, sec_no, 1, buffer);
 }
 
 /* Write sector SEC_NO to disk D from BUFFER, which must contain
@@ -244,23 +378,293 @@ disk_read (struct disk *d, disk_sector_t sec_no, void *buffer)
 void
 disk_write (struct disk *d, disk_sector_t sec_no, const void *buffer)
 {
-  struct channel *c;
-  
+  disk_write_multiple (d, sec_no, 1, buffer);
+}
+
+/* Reads the CNT consecutive sectors starting at SEC_NO from disk
+   D into BUFFER, which must have room for CNT * DISK_SECTOR_SIZE
+   bytes.  Uses as few disk commands as the controller allows.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+void
+disk_read_multiple (struct disk *d, disk_sector_t sec_no, size_t cnt,
+                    void *buffer) 
+{
+  request_and_wait (d, sec_no, cnt, buffer, false);
+}
+
+/* Writes the CNT consecutive sectors starting at SEC_NO to disk
+   D from BUFFER, which must contain CNT * DISK_SECTOR_SIZE
+   bytes.  Uses as few disk commands as the controller allows,
+   and returns after the disk has acknowledged receiving all the
+   data.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+void
+disk_write_multiple (struct disk *d, disk_sector_t sec_no, size_t cnt,
+                     const void *buffer) 
+{
+  request_and_wait (d, sec_no, cnt, (void *) buffer, true);
+}
+
+/* Initializes R as a request to move the CNT sectors starting at
+   SEC_NO between disk D and BUFFER, which must have room for CNT
+   * DISK_SECTOR_SIZE bytes: from BUFFER to the disk if WRITE is
+   true, from the disk into BUFFER otherwise.  CNT may be at most
+   DISK_REQUEST_MAX_SECTORS. */
+void
+disk_request_init (struct disk_request *r, struct disk *d,
+                   disk_sector_t sec_no, size_t cnt, void *buffer,
+                   bool write) 
+{
+  ASSERT (r != NULL);
   ASSERT (d != NULL);
   ASSERT (buffer != NULL);
+  ASSERT (cnt >= 1 && cnt <= DISK_REQUEST_MAX_SECTORS);
+  ASSERT (sec_no + cnt <= d->capacity);
+
+  r->disk = d;
+  r->sec_no = sec_no;
+  r->cnt = cnt;
+  r->buffer = buffer;
+  r->write = write;
+  sema_init (&r->done, 0);
+}
+
+/* Queues request R, which must have been initialized with
+   disk_request_init(), and returns without waiting for it.  R
+   and its buffer must stay valid until disk_wait() returns. */
+void
+disk_submit (struct disk_request *r) 
+{
+  struct channel *c = r->disk->channel;
 
-  c = d->channel;
   lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
-  output_sector (c, buffer);
-  sema_down (&c->completion_wait);
-  d->write_cnt++;
+  list_push_back (&c->queue, &r->elem);
+  cond_signal (&c->queue_ready, &c->lock);
   lock_release (&c->lock);
 }
-
+
+/* Waits for submitted request R to complete. */
+void
+disk_wait (struct disk_request *r) 
+{
+  sema_down (&r->done);
+}
+
+/* Moves CNT sectors starting at SEC_NO between disk D and
+   BUFFER, as disk_request_init() describes, and waits until
+   done.  Larger transfers are submitted as several requests,
+   which the dispatcher will merge again. */
+static void
+request_and_wait (struct disk *d, disk_sector_t sec_no, size_t cnt,
+                  void *buffer_, bool write) 
+{
+  struct disk_request r[4];
+  uint8_t *buffer = buffer_;
+
+  while (cnt > 0)
+    {
+      size_t r_cnt, i;
+
+      for (r_cnt = 0; r_cnt < sizeof r / sizeof *r && cnt > 0; r_cnt++)
+        {
+          size_t n = (cnt < DISK_REQUEST_MAX_SECTORS
+                      ? cnt : DISK_REQUEST_MAX_SECTORS);
+          disk_request_init (&r[r_cnt], d, sec_no, n, buffer, write);
+          disk_submit (&r[r_cnt]);
+          sec_no += n;
+          cnt -= n;
+          buffer += n * DISK_SECTOR_SIZE;
+        }
+      for (i = 0; i < r_cnt; i++)
+        disk_wait (&r[i]);
+    }
+}
+
+/* Returns the position of sector SEC_NO of disk D in the order
+   of a C-LOOK sweep over both disks of a channel. */
+static uint32_t
+sweep_pos (const struct disk *d, disk_sector_t sec_no) 
+{
+  return ((uint32_t) d->dev_no << 28) | sec_no;
+}
+
+/* Returns the number of PRDs needed to describe R's buffer. */
+static size_t
+prd_cnt (const struct disk_request *r) 
+{
+  size_t ofs = pg_ofs (r->buffer);
+  return DIV_ROUND_UP (ofs + r->cnt * DISK_SECTOR_SIZE, PGSIZE);
+}
+
+/* Returns true if R's buffer is in kernel memory, so that the
+   bus master can find it. */
+static bool
+dma_ok (const struct disk_request *r) 
+{
+  return is_kernel_vaddr (r->buffer);
+}
+
+/* Removes the next request to serve from channel C's queue, in
+   C-LOOK order, and moves it to BATCH followed by any queued
+   requests for the sectors that immediately follow it, as many
+   as fit in a single command.  Returns the first request moved.
+   C's queue must not be empty and C's lock must be held. */
+static struct disk_request *
+next_request (struct channel *c, struct list *batch) 
+{
+  struct disk_request *first = NULL, *lowest = NULL;
+  struct disk_request *last;
+  struct list_elem *e;
+  size_t sector_cnt, prds;
+  bool dma;
+
+  ASSERT (lock_held_by_current_thread (&c->lock));
+  ASSERT (!list_empty (&c->queue));
+
+  /* Choose the first request at or above the head position, or
+     the lowest one if none is left above the head. */
+  for (e = list_begin (&c->queue); e != list_end (&c->queue);
+       e = list_next (e))
+    {
+      struct disk_request *r = list_entry (e, struct disk_request, elem);
+      uint32_t pos = sweep_pos (r->disk, r->sec_no);
+
+      if (lowest == NULL || pos < sweep_pos (lowest->disk, lowest->sec_no))
+        lowest = r;
+      if (pos >= c->head
+          && (first == NULL
+              || pos < sweep_pos (first->disk, first->sec_no)))
+        first = r;
+    }
+  if (first == NULL)
+    first = lowest;
+  list_remove (&first->elem);
+  list_push_back (batch, &first->elem);
+
+  /* Merge requests for the sectors that follow. */
+  dma = first->disk->use_dma && dma_ok (first);
+  sector_cnt = first->cnt;
+  prds = prd_cnt (first);
+  last = first;
+  for (;;)
+    {
+      struct disk_request *next = NULL;
+
+      for (e = list_begin (&c->queue); e != list_end (&c->queue);
+           e = list_next (e))
+        {
+          struct disk_request *r = list_entry (e, struct disk_request, elem);
+          if (r->disk == first->disk && r->write == first->write
+              && r->sec_no == last->sec_no + last->cnt)
+            {
+              next = r;
+              break;
+            }
+        }
+      if (next == NULL
+          || sector_cnt + next->cnt > (dma ? DMA_MAX_SECTORS : PIO_MAX_SECTORS)
+          || (dma && (!dma_ok (next) || prds + prd_cnt (next) > PRD_CNT)))
+        break;
+
+      list_remove (&next->elem);
+      list_push_back (batch, &next->elem);
+      sector_cnt += next->cnt;
+      prds += prd_cnt (next);
+      last = next;
+    }
+
+  c->head = sweep_pos (last->disk, last->sec_no + last->cnt);
+  return first;
+}
+
+/* Dispatcher thread for CHANNEL.  Serves requests from its
+   queue, one command at a time. */
+static void
+dispatcher (void *channel) 
+{
+  struct channel *c = channel;
+
+  lock_acquire (&c->lock);
+  for (;;)
+    {
+      struct list batch;
+
+      /* Track busy periods for utilization statistics. */
+      if (list_empty (&c->queue))
+        {
+          if (c->busy)
+            c->busy_ticks += timer_elapsed (c->busy_since);
+          c->busy = false;
+          while (list_empty (&c->queue))
+            cond_wait (&c->queue_ready, &c->lock);
+        }
+      if (!c->busy)
+        {
+          c->busy_since = timer_ticks ();
+          c->busy = true;
+        }
+
+      list_init (&batch);
+      next_request (c, &batch);
+      lock_release (&c->lock);
+
+      /* Complete the requests that the interrupt handler did not
+         complete already. */
+      transfer (&batch);
+      while (!list_empty (&batch))
+        {
+          struct disk_request *r = list_entry (list_pop_front (&batch),
+                                               struct disk_request, elem);
+          sema_up (&r->done);
+        }
+
+      lock_acquire (&c->lock);
+    }
+}
+
+/* Performs the requests in BATCH, which are for consecutive
+   sectors of the same disk in the same direction, with a single
+   command.  Uses DMA if the disk supports it and every buffer is
+   in kernel memory, programmed I/O otherwise. */
+static void
+transfer (struct list *batch) 
+{
+  struct disk_request *first = list_entry (list_front (batch),
+                                           struct disk_request, elem);
+  struct disk *d = first->disk;
+  disk_sector_t sec_no = first->sec_no;
+  bool write = first->write;
+  bool dma = d->use_dma;
+  size_t cnt = 0;
+  struct list_elem *e;
+  bool success;
+
+  for (e = list_begin (batch); e != list_end (batch); e = list_next (e))
+    {
+      struct disk_request *r = list_entry (e, struct disk_request, elem);
+      cnt += r->cnt;
+      dma = dma && dma_ok (r);
+      d->request_cnt++;
+    }
+
+  /* After a DMA transfer, the requests may be gone already. */
+  if (dma)
+    success = dma_transfer (d, sec_no, cnt, batch, write);
+  else
+    success = pio_transfer (d, sec_no, cnt, batch, write);
+  if (!success)
+    PANIC ("%s: disk %s failed, sector=%"PRDSNu,
+           d->name, write ? "write" : "read", sec_no);
+
+  if (write)
+    d->write_cnt += cnt;
+  else
+    d->read_cnt += cnt;
+  d->command_cnt++;
+}
+
 /* Disk detection and identification. */
 
 static void print_ata_string (char *string, size_t size);
@@ -374,7 +778,7 @@ identify_ata_device (struct disk *d)
      indicating the device's response is ready, and read the data
      into our buffer. */
   select_device_wait (d);
-  issue_pio_command (c, CMD_IDENTIFY_DEVICE);
+  issue_command (c, CMD_IDENTIFY_DEVICE);
   sema_down (&c->completion_wait);
   if (!wait_while_busy (d))
     {
@@ -386,6 +790,22 @@ identify_ata_device (struct disk *d)
   /* Calculate capacity. */
   d->capacity = id[60] | ((uint32_t) id[61] << 16);
 
+  /* Use DMA if both the controller and the disk support it. */
+  d->use_dma = c->bm_base != 0 && (id[49] & 0x100) != 0;
+
+  /* Move the largest blocks the disk supports per PIO
+     interrupt. */
+  if ((id[47] & 0xff) > 1)
+    {
+      select_device_wait (d);
+      outb (reg_nsect (c), id[47] & 0xff);
+      issue_command (c, CMD_SET_MULTIPLE_MODE);
+      sema_down (&c->completion_wait);
+      wait_while_busy (d);
+      if ((inb (reg_alt_status (c)) & STA_ERR) == 0)
+        d->multiple_cnt = id[47] & 0xff;
+    }
+
   /* Print identification message. */
   printf ("%s: detected %'"PRDSNu" sector (", d->name, d->capacity);
   if (d->capacity > 1024 / DISK_SECTOR_SIZE * 1024 * 1024)
@@ -401,7 +821,66 @@ identify_ata_device (struct disk *d)
   print_ata_string ((char *) &id[27], 40);
   printf ("\", serial \"");
   print_ata_string ((char *) &id[10], 20);
-  printf ("\"\n");
+  printf ("\"%s\n", d->use_dma ? ", DMA" : "");
+}
+
+/* Reads the 32-bit register at byte offset REG in the PCI
+   configuration space of function FUNC of device DEV on bus
+   BUS. */
+static uint32_t
+pci_read_config (int bus, int dev, int func, int reg) 
+{
+  outl (PCI_CONFIG_ADDR,
+        0x80000000 | (bus << 16) | (dev << 11) | (func << 8) | reg);
+  return inl (PCI_CONFIG_DATA);
+}
+
+/* Writes VALUE to the 32-bit register at byte offset REG in the
+   PCI configuration space of function FUNC of device DEV on bus
+   BUS. */
+static void
+pci_write_config (int bus, int dev, int func, int reg, uint32_t value) 
+{
+  outl (PCI_CONFIG_ADDR,
+        0x80000000 | (bus << 16) | (dev << 11) | (func << 8) | reg);
+  outl (PCI_CONFIG_DATA, value);
+}
+
+/* Looks on PCI bus 0 for an IDE controller that can act as a
+   bus master, enables bus mastering on it, and returns the I/O
+   port base of its bus master registers.  Returns 0 if there is
+   no such controller, in which case disks are driven by
+   programmed I/O only. */
+static uint16_t
+find_bus_master (void) 
+{
+  int dev, func;
+
+  for (dev = 0; dev < 32; dev++)
+    for (func = 0; func < 8; func++)
+      {
+        uint32_t class, bar;
+
+        if ((pci_read_config (0, dev, func, 0x00) & 0xffff) == 0xffff)
+          continue;
+
+        /* Class 01h (mass storage), subclass 01h (IDE), with
+           programming interface bit 7 (bus master capable). */
+        class = pci_read_config (0, dev, func, 0x08) >> 8;
+        if ((class >> 8) != 0x0101 || (class & 0x80) == 0)
+          continue;
+
+        /* BAR4 holds the bus master registers, in I/O space. */
+        bar = pci_read_config (0, dev, func, 0x20);
+        if ((bar & 1) == 0 || (bar & 0xfffc) == 0)
+          continue;
+
+        /* Enable I/O space access and bus mastering. */
+        pci_write_config (0, dev, func, 0x04,
+                          pci_read_config (0, dev, func, 0x04) | 0x5);
+        return bar & 0xfffc;
+      }
+  return 0;
 }
 
 /* Prints STRING, which consists of SIZE bytes in a funky format:
@@ -426,18 +905,20 @@ print_ata_string (char *string, size_t size)
 }
 
 /* Selects device D, waiting for it to become ready, and then
-   writes SEC_NO to the disk's sector selection registers.  (We
-   use LBA mode.) */
+   writes SEC_NO and CNT to the disk's sector selection
+   registers, to address CNT sectors starting at SEC_NO.  (We use
+   LBA mode.) */
 static void
-select_sector (struct disk *d, disk_sector_t sec_no) 
+select_sector (struct disk *d, disk_sector_t sec_no, size_t cnt) 
 {
   struct channel *c = d->channel;
 
-  ASSERT (sec_no < d->capacity);
-  ASSERT (sec_no < (1UL << 28));
+  ASSERT (cnt >= 1 && cnt <= 256);
+  ASSERT (sec_no + cnt <= d->capacity);
+  ASSERT (sec_no + cnt <= (1UL << 28));
   
   select_device_wait (d);
-  outb (reg_nsect (c), 1);
+  outb (reg_nsect (c), cnt == 256 ? 0 : cnt);
   outb (reg_lbal (c), sec_no);
   outb (reg_lbam (c), sec_no >> 8);
   outb (reg_lbah (c), (sec_no >> 16));
@@ -448,7 +929,7 @@ select_sector (struct disk *d, disk_sector_t sec_no)
 /* Writes COMMAND to channel C and prepares for receiving a
    completion interrupt. */
 static void
-issue_pio_command (struct channel *c, uint8_t command) 
+issue_command (struct channel *c, uint8_t command) 
 {
   /* Interrupts must be enabled or our semaphore will never be
      up'd by the completion handler. */
@@ -473,6 +954,124 @@ output_sector (struct channel *c, const void *sector)
 {
   outsw (reg_data (c), sector, DISK_SECTOR_SIZE / 2);
 }
+
+/* Moves CNT sectors starting at SEC_NO between disk D and the
+   buffers of the requests in BATCH, taken in order, with a
+   single PIO command.  Moves data to the disk if WRITE is true,
+   from the disk otherwise.  Data moves in blocks of D's
+   multiple_cnt sectors, with an interrupt per block.  Returns
+   true if successful, false if the disk reported an error. */
+static bool
+pio_transfer (struct disk *d, disk_sector_t sec_no, size_t cnt,
+              struct list *batch, bool write) 
+{
+  struct channel *c = d->channel;
+  struct list_elem *e = list_begin (batch);
+  size_t r_ofs = 0;
+  size_t block = d->multiple_cnt;
+  uint8_t command;
+
+  if (block > 1)
+    command = write ? CMD_WRITE_MULTIPLE : CMD_READ_MULTIPLE;
+  else
+    command = write ? CMD_WRITE_SECTOR_RETRY : CMD_READ_SECTOR_RETRY;
+
+  select_sector (d, sec_no, cnt);
+  issue_command (c, command);
+  while (cnt > 0)
+    {
+      size_t n = cnt < block ? cnt : block;
+      size_t i;
+
+      /* A read block is ready when its interrupt arrives.  A
+         write block may be sent as soon as DRQ is set, and its
+         interrupt says that the disk has taken it. */
+      if (!write)
+        sema_down (&c->completion_wait);
+      if (!wait_while_busy (d))
+        return false;
+      for (i = 0; i < n; i++)
+        {
+          struct disk_request *r = list_entry (e, struct disk_request, elem);
+          uint8_t *buffer = (uint8_t *) r->buffer + r_ofs * DISK_SECTOR_SIZE;
+
+          if (write)
+            output_sector (c, buffer);
+          else
+            input_sector (c, buffer);
+          if (++r_ofs == r->cnt)
+            {
+              e = list_next (e);
+              r_ofs = 0;
+            }
+        }
+      if (write)
+        sema_down (&c->completion_wait);
+      cnt -= n;
+    }
+  return true;
+}
+
+/* Moves CNT sectors starting at SEC_NO between disk D and the
+   buffers of the requests in BATCH, taken in order, with a
+   single DMA command.  The buffers must be in kernel memory.
+   Moves data to the disk if WRITE is true, from the disk
+   otherwise.  If successful, the interrupt handler removes the
+   requests from BATCH and completes them, and returns true.
+   Returns false, leaving BATCH alone, if the controller or the
+   disk reported an error. */
+static bool
+dma_transfer (struct disk *d, disk_sector_t sec_no, size_t cnt,
+              struct list *batch, bool write) 
+{
+  struct channel *c = d->channel;
+  uint8_t direction = write ? 0 : BM_READ;
+  size_t prd_cnt = 0;
+  struct list_elem *e;
+
+  ASSERT (cnt <= DMA_MAX_SECTORS);
+
+  /* Describe the buffers, a page at a time since physical pages
+     need not be contiguous. */
+  for (e = list_begin (batch); e != list_end (batch); e = list_next (e))
+    {
+      struct disk_request *r = list_entry (e, struct disk_request, elem);
+      uint8_t *p = r->buffer;
+      size_t left = r->cnt * DISK_SECTOR_SIZE;
+
+      while (left > 0)
+        {
+          size_t size = PGSIZE - pg_ofs (p);
+          if (size > left)
+            size = left;
+
+          ASSERT (prd_cnt < PRD_CNT);
+          c->prdt[prd_cnt].addr = vtop (p);
+          c->prdt[prd_cnt].size = size;
+          c->prdt[prd_cnt].flags = 0;
+          prd_cnt++;
+
+          p += size;
+          left -= size;
+        }
+    }
+  c->prdt[prd_cnt - 1].flags = PRD_EOT;
+
+  /* Program the bus master, issue the command, then start the
+     bus master and wait for the completion interrupt. */
+  outl (reg_bm_prdt (c), vtop (c->prdt));
+  outb (reg_bm_command (c), direction);
+  outb (reg_bm_status (c), BM_ERROR | BM_INTR);
+  select_sector (d, sec_no, cnt);
+  c->dma_batch = batch;
+  issue_command (c, write ? CMD_WRITE_DMA : CMD_READ_DMA);
+  outb (reg_bm_command (c), direction | BM_START);
+  sema_down (&c->completion_wait);
+  outb (reg_bm_command (c), direction);
+  c->dma_batch = NULL;
+
+  return (c->bm_status & BM_ERROR) == 0 && (c->status & STA_ERR) == 0;
+}
 
 /* Low-level ATA primitives. */
 
@@ -557,7 +1156,26 @@ interrupt_handler (struct intr_frame *f)
       {
         if (c->expecting_interrupt) 
           {
-            inb (reg_status (c));               /* Acknowledge interrupt. */
+            if (c->bm_base != 0)
+              {
+                /* Record and clear the bus master's status. */
+                c->bm_status = inb (reg_bm_status (c));
+                outb (reg_bm_status (c), BM_ERROR | BM_INTR);
+              }
+            c->status = inb (reg_status (c));   /* Acknowledge interrupt. */
+
+            /* Complete a successful DMA command's requests right
+               away, rather than when the dispatcher runs. */
+            if (c->dma_batch != NULL
+                && (c->bm_status & BM_ERROR) == 0
+                && (c->status & STA_ERR) == 0)
+              while (!list_empty (c->dma_batch))
+                {
+                  struct list_elem *e = list_pop_front (c->dma_batch);
+                  sema_up (&list_entry (e, struct disk_request,
+                                        elem)->done);
+                }
+
             sema_up (&c->completion_wait);      /* Wake up waiter. */
           }
         else
@@ -2,7 +2,11 @@
 #define DEVICES_DISK_H
 
 #include <inttypes.h>
+#include <list.h>
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
+#include "threads/synch.h"
 
 /* Size of a disk sector in bytes. */
 #define DISK_SECTOR_SIZE 512
@@ -15,6 +19,24 @@ typedef uint32_t disk_sector_t;
    printf ("sector=%"PRDSNu"\n", sector); */
 #define PRDSNu PRIu32
 
+/* Maximum number of sectors in one disk_request. */
+#define DISK_REQUEST_MAX_SECTORS 64
+
+/* An asynchronous disk request.
+   Initialize with disk_request_init(), start with
+   disk_submit(), and wait for completion with disk_wait().  The
+   members are private to the disk driver. */
+struct disk_request
+  {
+    struct list_elem elem;      /* Element in channel's queue. */
+    struct disk *disk;          /* Disk to access. */
+    disk_sector_t sec_no;       /* First sector. */
+    size_t cnt;                 /* Number of sectors. */
+    void *buffer;               /* Data, CNT * DISK_SECTOR_SIZE bytes. */
+    bool write;                 /* Write to disk?  Else read. */
+    struct semaphore done;      /* Up'd on completion. */
+  };
+
 void disk_init (void);
 void disk_print_stats (void);
 
@@ -22,5 +44,13 @@ struct disk *disk_get (int chan_no, int dev_no);
 disk_sector_t disk_size (struct disk *);
 void disk_read (struct disk *, disk_sector_t, void *);
 void disk_write (struct disk *, disk_sector_t, const void *);
+void disk_read_multiple (struct disk *, disk_sector_t, size_t cnt, void *);
+void disk_write_multiple (struct disk *, disk_sector_t, size_t cnt,
+                          const void *);
+
+void disk_request_init (struct disk_request *, struct disk *,
+                        disk_sector_t, size_t cnt, void *, bool write);
+void disk_submit (struct disk_request *);
+void disk_wait (struct disk_request *);
 
 #endif /* devices/disk.h */
@@ -0,0 +1,358 @@
+#include "filesys/cache.h"
+#include <debug.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/filesys.h"
+#include "devices/timer.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Number of sectors held in the buffer cache. */
+#define CACHE_SIZE 64
+
+/* Timer ticks between two runs of the write-behind thread. */
+#define WRITE_BEHIND_TICKS TIMER_FREQ
+
+/* Maximum number of pending read-ahead requests.  Requests that
+   arrive while the queue is full are dropped. */
+#define READ_AHEAD_QUEUE_SIZE 32
+
+/* A file system sector held in memory. */
+struct cache_entry
+  {
+    disk_sector_t sector;               /* Sector number of disk location. */
+    bool valid;                         /* True if DATA holds SECTOR. */
+    bool dirty;                         /* True if DATA is newer than disk. */
+    bool accessed;                      /* Used since the clock hand passed? */
+    bool busy;                          /* Disk transfer in progress? */
+    bool read_ahead;                    /* Read ahead and not yet used? */
+    int pin_cnt;                        /* Number of copies in progress. */
+    uint8_t data[DISK_SECTOR_SIZE];     /* Sector contents. */
+  };
+
+/* The buffer cache.  CACHE_LOCK protects every entry, CLOCK_HAND
+   and the read-ahead queue.  It is released during disk
+   transfers; the entry being transferred is marked busy
+   meanwhile, and IO_DONE is broadcast when a transfer ends.
+   It is also released while data is copied to or from a
+   caller's buffer, which may be in user memory and page fault;
+   the entry is pinned meanwhile so that it cannot be evicted. */
+static struct cache_entry cache[CACHE_SIZE];
+static struct lock cache_lock;
+static struct condition io_done;
+static size_t clock_hand;
+
+/* Sectors waiting to be read ahead, as a circular queue.
+   READ_AHEAD_READY is signaled when a sector is queued. */
+static disk_sector_t read_ahead_queue[READ_AHEAD_QUEUE_SIZE];
+static size_t read_ahead_head;
+static size_t read_ahead_cnt;
+static struct condition read_ahead_ready;
+
+/* Statistics. */
+static long long hit_cnt;               /* Accesses found in the cache. */
+static long long miss_cnt;              /* Accesses that had to wait. */
+static long long read_ahead_sector_cnt; /* Sectors read ahead. */
+static long long read_ahead_hit_cnt;    /* Read-ahead sectors later used. */
+
+static void write_behind (void *aux);
+static void read_ahead (void *aux);
+
+/* Initializes the buffer cache and starts the write-behind and
+   read-ahead threads. */
+void
+cache_init (void)
+{
+  size_t i;
+
+  lock_init (&cache_lock);
+  cond_init (&io_done);
+  cond_init (&read_ahead_ready);
+  for (i = 0; i < CACHE_SIZE; i++)
+    {
+      cache[i].valid = false;
+      cache[i].busy = false;
+      cache[i].pin_cnt = 0;
+    }
+  clock_hand = 0;
+  read_ahead_head = read_ahead_cnt = 0;
+
+  thread_create ("write-behind", PRI_DEFAULT, write_behind, NULL);
+  thread_create ("read-ahead", PRI_DEFAULT, read_ahead, NULL);
+}
+
+/* Writes every dirty sector back to disk.  Called when the file
+   system shuts down. */
+void
+cache_done (void)
+{
+  cache_flush ();
+}
+
+/* Prints buffer cache statistics. */
+void
+cache_print_stats (void)
+{
+  printf ("Cache: %lld hits, %lld misses, "
+          "%lld sectors read ahead, %lld read-ahead hits\n",
+          hit_cnt, miss_cnt, read_ahead_sector_cnt, read_ahead_hit_cnt);
+}
+
+/* Writes E, which must be valid, dirty, not busy and not pinned,
+   back to disk.  Releases the cache lock during the transfer.
+   E is marked clean before the transfer starts, so that a write
+   made after it is not forgotten; being busy, E cannot be
+   written to until the transfer ends anyway. */
+static void
+write_back (struct cache_entry *e)
+{
+  ASSERT (lock_held_by_current_thread (&cache_lock));
+  ASSERT (e->valid && e->dirty && !e->busy && e->pin_cnt == 0);
+
+  e->busy = true;
+  e->dirty = false;
+  lock_release (&cache_lock);
+  disk_write (filesys_disk, e->sector, e->data);
+  lock_acquire (&cache_lock);
+  e->busy = false;
+  cond_broadcast (&io_done, &cache_lock);
+}
+
+/* Returns the entry caching SECTOR, or a null pointer if SECTOR
+   is not in the cache. */
+static struct cache_entry *
+lookup (disk_sector_t sector)
+{
+  size_t i;
+
+  for (i = 0; i < CACHE_SIZE; i++)
+    if (cache[i].valid && cache[i].sector == sector)
+      return &cache[i];
+  return NULL;
+}
+
+/* Chooses a clean entry to reuse with the clock algorithm and
+   returns it invalidated.  If the chosen entry is dirty, or if
+   every entry is busy or pinned, waits for a disk transfer and returns a
+   null pointer instead, because the cache may have changed
+   meanwhile; the caller must then retry. */
+static struct cache_entry *
+evict (void)
+{
+  size_t i;
+
+  for (i = 0; i < 2 * CACHE_SIZE; i++)
+    {
+      struct cache_entry *e = &cache[clock_hand];
+      clock_hand = (clock_hand + 1) % CACHE_SIZE;
+
+      if (!e->valid)
+        return e;
+      else if (e->busy || e->pin_cnt > 0)
+        continue;
+      else if (e->accessed)
+        e->accessed = false;
+      else if (e->dirty)
+        {
+          write_back (e);
+          return NULL;
+        }
+      else
+        {
+          e->valid = false;
+          return e;
+        }
+    }
+
+  cond_wait (&io_done, &cache_lock);
+  return NULL;
+}
+
+/* Returns the entry for SECTOR, bringing it into the cache if
+   necessary.  If FILL is false the caller is about to overwrite
+   the whole sector, so its old contents are not read from
+   disk.  READ_AHEAD is true only for the read-ahead thread.
+   The returned entry is valid and not busy, and stays so until
+   the caller releases the cache lock. */
+static struct cache_entry *
+get_entry (disk_sector_t sector, bool fill, bool read_ahead)
+{
+  struct cache_entry *e;
+
+  ASSERT (lock_held_by_current_thread (&cache_lock));
+
+  for (;;)
+    {
+      e = lookup (sector);
+      if (e != NULL)
+        {
+          if (e->busy)
+            {
+              cond_wait (&io_done, &cache_lock);
+              continue;
+            }
+          if (!read_ahead)
+            hit_cnt++;
+          break;
+        }
+
+      e = evict ();
+      if (e == NULL)
+        continue;
+
+      if (read_ahead)
+        read_ahead_sector_cnt++;
+      else
+        miss_cnt++;
+      e->sector = sector;
+      e->valid = true;
+      e->dirty = false;
+      e->read_ahead = read_ahead;
+      if (fill)
+        {
+          e->busy = true;
+          lock_release (&cache_lock);
+          disk_read (filesys_disk, sector, e->data);
+          lock_acquire (&cache_lock);
+          e->busy = false;
+          cond_broadcast (&io_done, &cache_lock);
+        }
+      break;
+    }
+
+  e->accessed = true;
+  return e;
+}
+
+/* Pins E for a copy to or from a caller's buffer and releases
+   the cache lock. */
+static void
+pin (struct cache_entry *e)
+{
+  if (e->read_ahead)
+    {
+      read_ahead_hit_cnt++;
+      e->read_ahead = false;
+    }
+  e->pin_cnt++;
+  lock_release (&cache_lock);
+}
+
+/* Reacquires the cache lock and unpins E. */
+static void
+unpin (struct cache_entry *e)
+{
+  lock_acquire (&cache_lock);
+  ASSERT (e->pin_cnt > 0);
+  if (--e->pin_cnt == 0)
+    cond_broadcast (&io_done, &cache_lock);
+}
+
+/* Reads SIZE bytes starting at byte OFS within SECTOR into
+   BUFFER. */
+void
+cache_read (disk_sector_t sector, void *buffer, size_t ofs, size_t size)
+{
+  struct cache_entry *e;
+
+  ASSERT (ofs + size <= DISK_SECTOR_SIZE);
+
+  lock_acquire (&cache_lock);
+  e = get_entry (sector, true, false);
+  pin (e);
+  memcpy (buffer, e->data + ofs, size);
+  unpin (e);
+  lock_release (&cache_lock);
+}
+
+/* Writes SIZE bytes from BUFFER to SECTOR, starting at byte OFS
+   within the sector.  The data reaches the disk when the sector
+   is evicted or flushed. */
+void
+cache_write (disk_sector_t sector, const void *buffer, size_t ofs,
+             size_t size)
+{
+  struct cache_entry *e;
+
+  ASSERT (ofs + size <= DISK_SECTOR_SIZE);
+
+  lock_acquire (&cache_lock);
+  e = get_entry (sector, ofs != 0 || size != DISK_SECTOR_SIZE, false);
+  pin (e);
+  memcpy (e->data + ofs, buffer, size);
+  unpin (e);
+  e->dirty = true;
+  lock_release (&cache_lock);
+}
+
+/* Asks the read-ahead thread to bring SECTOR into the cache.
+   Returns without waiting for the disk. */
+void
+cache_read_ahead (disk_sector_t sector)
+{
+  lock_acquire (&cache_lock);
+  if (lookup (sector) == NULL && read_ahead_cnt < READ_AHEAD_QUEUE_SIZE)
+    {
+      size_t tail = read_ahead_head + read_ahead_cnt;
+      read_ahead_queue[tail % READ_AHEAD_QUEUE_SIZE] = sector;
+      read_ahead_cnt++;
+      cond_signal (&read_ahead_ready, &cache_lock);
+    }
+  lock_release (&cache_lock);
+}
+
+/* Writes all dirty sectors back to disk.  Waits for copies into
+   pinned sectors to finish, so that no half-written sector
+   reaches the disk. */
+void
+cache_flush (void)
+{
+  size_t i;
+
+  lock_acquire (&cache_lock);
+  for (i = 0; i < CACHE_SIZE; i++)
+    {
+      struct cache_entry *e = &cache[i];
+      while (e->busy || e->pin_cnt > 0)
+        cond_wait (&io_done, &cache_lock);
+      if (e->valid && e->dirty)
+        write_back (e);
+    }
+  lock_release (&cache_lock);
+}
+
+/* Write-behind thread.  Periodically flushes dirty sectors so
+   that a crash loses at most WRITE_BEHIND_TICKS worth of
+   writes. */
+static void
+write_behind (void *aux UNUSED)
+{
+  for (;;)
+    {
+      timer_sleep (WRITE_BEHIND_TICKS);
+      cache_flush ();
+    }
+}
+
+/* Read-ahead thread.  Reads queued sectors into the cache so
+   that a sequential reader finds them there. */
+static void
+read_ahead (void *aux UNUSED)
+{
+  lock_acquire (&cache_lock);
+  for (;;)
+    {
+      disk_sector_t sector;
+
+      while (read_ahead_cnt == 0)
+        cond_wait (&read_ahead_ready, &cache_lock);
+      sector = read_ahead_queue[read_ahead_head];
+      read_ahead_head = (read_ahead_head + 1) % READ_AHEAD_QUEUE_SIZE;
+      read_ahead_cnt--;
+
+      if (lookup (sector) == NULL)
+        get_entry (sector, true, true);
+    }
+}
@@ -0,0 +1,15 @@
+#ifndef FILESYS_CACHE_H
+#define FILESYS_CACHE_H
+
+#include <stddef.h>
+#include "devices/disk.h"
+
+void cache_init (void);
+void cache_done (void);
+void cache_print_stats (void);
+void cache_read (disk_sector_t, void *, size_t ofs, size_t size);
+void cache_write (disk_sector_t, const void *, size_t ofs, size_t size);
+void cache_read_ahead (disk_sector_t);
+void cache_flush (void);
+
+#endif /* filesys/cache.h */
@@ -1,16 +1,41 @@
 #include "filesys/directory.h"
 #include <stdio.h>
 #include <string.h>
+#include <hash.h>
 #include <list.h>
+#include <round.h>
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
 #include "threads/malloc.h"
 
-/* A directory. */
+/* Identifies a hashed directory. */
+#define DIR_MAGIC 0x48444952
+
+/* A directory.
+
+   On disk, a directory is a header sector followed by BUCKET_CNT
+   bucket sectors, each holding BUCKET_ENTRIES directory entries.
+   A name is stored in the first bucket, starting from its hash
+   bucket and probing linearly, that has a slot not in use.  Slots
+   that once held an entry are marked deleted rather than free,
+   so that a lookup may stop at the first free slot it meets.
+   The table is rebuilt with twice as many buckets once it gets
+   three quarters full, so a lookup normally reads the header and
+   one or two bucket sectors. */
 struct dir 
   {
     struct inode *inode;                /* Backing store. */
-    off_t pos;                          /* Current position. */
+    off_t pos;                          /* Current slot for readdir. */
+  };
+
+/* On-disk directory header, stored in the directory's first
+   sector. */
+struct dir_header
+  {
+    unsigned magic;                     /* Magic number. */
+    uint32_t bucket_cnt;                /* Number of buckets. */
+    uint32_t entry_cnt;                 /* Number of slots in use. */
+    uint32_t used_cnt;                  /* Slots in use or deleted. */
   };
 
 /* A single directory entry. */
@@ -19,14 +44,163 @@ struct dir_entry
     disk_sector_t inode_sector;         /* Sector number of header. */
     char name[NAME_MAX + 1];            /* Null terminated file name. */
     bool in_use;                        /* In use or free? */
+    bool deleted;                       /* Free, but was once in use? */
   };
 
+/* Number of directory entries in one bucket sector. */
+#define BUCKET_ENTRIES (DISK_SECTOR_SIZE / sizeof (struct dir_entry))
+
+/* Returns the byte offset of slot SLOT within a directory. */
+static off_t
+slot_to_ofs (size_t slot)
+{
+  return (DISK_SECTOR_SIZE * (1 + slot / BUCKET_ENTRIES)
+          + sizeof (struct dir_entry) * (slot % BUCKET_ENTRIES));
+}
+
+/* Reads INODE's directory header into *H.
+   Returns true if successful, false on failure. */
+static bool
+read_header (struct inode *inode, struct dir_header *h)
+{
+  return (inode_read_at (inode, h, sizeof *h, 0) == sizeof *h
+          && h->magic == DIR_MAGIC);
+}
+
+/* Writes H as INODE's directory header.
+   Returns true if successful, false on failure. */
+static bool
+write_header (struct inode *inode, const struct dir_header *h)
+{
+  return inode_write_at (inode, h, sizeof *h, 0) == sizeof *h;
+}
+
+/* Returns the bucket in which the search for NAME starts in a
+   directory with BUCKET_CNT buckets. */
+static size_t
+home_bucket (const char *name, size_t bucket_cnt)
+{
+  return hash_string (name) % bucket_cnt;
+}
+
+/* Stores E in the first slot of INODE's directory, as described
+   by header H, that is not in use along NAME's probe sequence,
+   and updates H's counts.  Does not write H back.
+   Returns true if successful, false if the table is full or on
+   a disk error. */
+static bool
+insert_entry (struct inode *inode, struct dir_header *h,
+              const struct dir_entry *e)
+{
+  size_t bucket = home_bucket (e->name, h->bucket_cnt);
+  size_t probe;
+
+  for (probe = 0; probe < h->bucket_cnt; probe++)
+    {
+      size_t slot = bucket * BUCKET_ENTRIES;
+      size_t end = slot + BUCKET_ENTRIES;
+
+      for (; slot < end; slot++)
+        {
+          struct dir_entry old;
+          off_t ofs = slot_to_ofs (slot);
+
+          if (inode_read_at (inode, &old, sizeof old, ofs) != sizeof old)
+            return false;
+          if (!old.in_use)
+            {
+              if (inode_write_at (inode, e, sizeof *e, ofs) != sizeof *e)
+                return false;
+              if (!old.deleted)
+                h->used_cnt++;
+              h->entry_cnt++;
+              return true;
+            }
+        }
+      bucket = (bucket + 1) % h->bucket_cnt;
+    }
+  return false;
+}
+
+/* Rebuilds INODE's directory, described by header H, with
+   BUCKET_CNT buckets, dropping deleted slots along the way.
+   Writes the new header back into H and to disk.
+   Returns true if successful.  On failure, the directory is left
+   unchanged if possible. */
+static bool
+rehash (struct inode *inode, struct dir_header *h, size_t bucket_cnt)
+{
+  static const char zeros[DISK_SECTOR_SIZE];
+  struct dir_entry *entries;
+  size_t entry_cnt = 0;
+  size_t slot, i;
+  bool success = false;
+
+  ASSERT (bucket_cnt >= h->bucket_cnt);
+
+  /* Grow the directory file first, so that running out of disk
+     space fails before any entry has moved. */
+  for (i = h->bucket_cnt; i < bucket_cnt; i++)
+    if (inode_write_at (inode, zeros, DISK_SECTOR_SIZE,
+                        DISK_SECTOR_SIZE * (1 + i)) != DISK_SECTOR_SIZE)
+      return false;
+
+  /* Gather the live entries. */
+  entries = malloc (h->entry_cnt * sizeof *entries);
+  if (entries == NULL && h->entry_cnt > 0)
+    return false;
+  for (slot = 0; slot < h->bucket_cnt * BUCKET_ENTRIES; slot++)
+    {
+      struct dir_entry e;
+      if (inode_read_at (inode, &e, sizeof e, slot_to_ofs (slot)) != sizeof e)
+        goto done;
+      if (e.in_use && entry_cnt < h->entry_cnt)
+        entries[entry_cnt++] = e;
+    }
+
+  /* Clear the old buckets and insert the entries again. */
+  for (i = 0; i < h->bucket_cnt; i++)
+    if (inode_write_at (inode, zeros, DISK_SECTOR_SIZE,
+                        DISK_SECTOR_SIZE * (1 + i)) != DISK_SECTOR_SIZE)
+      goto done;
+  h->bucket_cnt = bucket_cnt;
+  h->entry_cnt = h->used_cnt = 0;
+  for (i = 0; i < entry_cnt; i++)
+    if (!insert_entry (inode, h, &entries[i]))
+      goto done;
+  success = true;
+
+ done:
+  write_header (inode, h);
+  free (entries);
+  return success;
+}
+
 /* Creates a directory with space for ENTRY_CNT entries in the
    given SECTOR.  Returns true if successful, false on failure. */
 bool
 dir_create (disk_sector_t sector, size_t entry_cnt) 
 {
-  return inode_create (sector, entry_cnt * sizeof (struct dir_entry));
+  struct dir_header h;
+  struct inode *inode;
+  bool success;
+
+  h.magic = DIR_MAGIC;
+  h.bucket_cnt = DIV_ROUND_UP (entry_cnt * 2, BUCKET_ENTRIES);
+  if (h.bucket_cnt == 0)
+    h.bucket_cnt = 1;
+  h.entry_cnt = h.used_cnt = 0;
+
+  /* Freshly created inodes are zeroed, so every slot starts out
+     free. */
+  if (!inode_create (sector, DISK_SECTOR_SIZE * (1 + h.bucket_cnt)))
+    return false;
+  inode = inode_open (sector);
+  if (inode == NULL)
+    return false;
+  success = write_header (inode, &h);
+  inode_close (inode);
+  return success;
 }
 
 /* Opens and returns the directory for the given INODE, of which
@@ -92,22 +266,44 @@ static bool
 lookup (const struct dir *dir, const char *name,
         struct dir_entry *ep, off_t *ofsp) 
 {
-  struct dir_entry e;
-  size_t ofs;
+  struct dir_header h;
+  size_t bucket, probe;
   
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e) 
-    if (e.in_use && !strcmp (name, e.name)) 
-      {
-        if (ep != NULL)
-          *ep = e;
-        if (ofsp != NULL)
-          *ofsp = ofs;
-        return true;
-      }
+  if (!read_header (dir->inode, &h))
+    return false;
+
+  bucket = home_bucket (name, h.bucket_cnt);
+  for (probe = 0; probe < h.bucket_cnt; probe++)
+    {
+      size_t slot = bucket * BUCKET_ENTRIES;
+      size_t end = slot + BUCKET_ENTRIES;
+
+      for (; slot < end; slot++)
+        {
+          struct dir_entry e;
+          off_t ofs = slot_to_ofs (slot);
+
+          if (inode_read_at (dir->inode, &e, sizeof e, ofs) != sizeof e)
+            return false;
+          if (e.in_use && !strcmp (name, e.name)) 
+            {
+              if (ep != NULL)
+                *ep = e;
+              if (ofsp != NULL)
+                *ofsp = ofs;
+              return true;
+            }
+          else if (!e.in_use && !e.deleted)
+            {
+              /* NAME would have been stored here. */
+              return false;
+            }
+        }
+      bucket = (bucket + 1) % h.bucket_cnt;
+    }
   return false;
 }
 
@@ -124,10 +320,12 @@ dir_lookup (const struct dir *dir, const char *name,
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
+  inode_lock (dir->inode);
   if (lookup (dir, name, &e, NULL))
     *inode = inode_open (e.inode_sector);
   else
     *inode = NULL;
+  inode_unlock (dir->inode);
 
   return *inode != NULL;
 }
@@ -141,8 +339,8 @@ dir_lookup (const struct dir *dir, const char *name,
 bool
 dir_add (struct dir *dir, const char *name, disk_sector_t inode_sector) 
 {
+  struct dir_header h;
   struct dir_entry e;
-  off_t ofs;
   bool success = false;
   
   ASSERT (dir != NULL);
@@ -153,28 +351,33 @@ dir_add (struct dir *dir, const char *name, disk_sector_t inode_sector)
     return false;
 
   /* Check that NAME is not in use. */
-  if (lookup (dir, name, NULL, NULL))
+  inode_lock (dir->inode);
+  if (lookup (dir, name, NULL, NULL) || !read_header (dir->inode, &h))
     goto done;
 
-  /* Set OFS to offset of free slot.
-     If there are no free slots, then it will be set to the
-     current end-of-file.
-     
-     inode_read_at() will only return a short read at end of file.
-     Otherwise, we'd need to verify that we didn't get a short
-     read due to something intermittent such as low memory. */
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e) 
-    if (!e.in_use)
-      break;
+  /* Keep at least a quarter of the slots free, so that probe
+     sequences stay short.  Double the table if it is at least
+     half full of live entries; otherwise rebuilding it in place
+     is enough to get rid of deleted slots. */
+  if ((h.used_cnt + 1) * 4 > h.bucket_cnt * BUCKET_ENTRIES * 3)
+    {
+      size_t bucket_cnt = h.bucket_cnt;
+      if ((h.entry_cnt + 1) * 2 > h.bucket_cnt * BUCKET_ENTRIES)
+        bucket_cnt *= 2;
+      if (!rehash (dir->inode, &h, bucket_cnt))
+        goto done;
+    }
 
   /* Write slot. */
+  memset (&e, 0, sizeof e);
   e.in_use = true;
   strlcpy (e.name, name, sizeof e.name);
   e.inode_sector = inode_sector;
-  success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+  success = (insert_entry (dir->inode, &h, &e)
+             && write_header (dir->inode, &h));
 
  done:
+  inode_unlock (dir->inode);
   return success;
 }
 
@@ -184,6 +387,7 @@ dir_add (struct dir *dir, const char *name, disk_sector_t inode_sector)
 bool
 dir_remove (struct dir *dir, const char *name) 
 {
+  struct dir_header h;
   struct dir_entry e;
   struct inode *inode = NULL;
   bool success = false;
@@ -193,6 +397,7 @@ dir_remove (struct dir *dir, const char *name)
   ASSERT (name != NULL);
 
   /* Find directory entry. */
+  inode_lock (dir->inode);
   if (!lookup (dir, name, &e, &ofs))
     goto done;
 
@@ -202,15 +407,21 @@ dir_remove (struct dir *dir, const char *name)
     goto done;
 
   /* Erase directory entry. */
+  if (!read_header (dir->inode, &h))
+    goto done;
   e.in_use = false;
+  e.deleted = true;
   if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e) 
     goto done;
+  h.entry_cnt--;
+  write_header (dir->inode, &h);
 
   /* Remove inode. */
   inode_remove (inode);
   success = true;
 
  done:
+  inode_unlock (dir->inode);
   inode_close (inode);
   return success;
 }
@@ -221,16 +432,28 @@ dir_remove (struct dir *dir, const char *name)
 bool
 dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
 {
+  struct dir_header h;
   struct dir_entry e;
+  bool success = false;
+
+  inode_lock (dir->inode);
+  if (!read_header (dir->inode, &h))
+    goto done;
 
-  while (inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e) 
+  while ((size_t) dir->pos < h.bucket_cnt * BUCKET_ENTRIES
+         && (inode_read_at (dir->inode, &e, sizeof e, slot_to_ofs (dir->pos))
+             == sizeof e))
     {
-      dir->pos += sizeof e;
+      dir->pos++;
       if (e.in_use)
         {
           strlcpy (name, e.name, NAME_MAX + 1);
-          return true;
+          success = true;
+          break;
         } 
     }
-  return false;
+
+ done:
+  inode_unlock (dir->inode);
+  return success;
 }
@@ -4,9 +4,11 @@
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "threads/synch.h"
 
 static struct file *free_map_file;   /* Free map file. */
 static struct bitmap *free_map;      /* Free map, one bit per disk sector. */
+static struct lock free_map_lock;    /* Protects free_map and its file. */
 
 /* Initializes the free map. */
 void
@@ -17,16 +19,21 @@ free_map_init (void)
     PANIC ("bitmap creation failed--disk is too large");
   bitmap_mark (free_map, FREE_MAP_SECTOR);
   bitmap_mark (free_map, ROOT_DIR_SECTOR);
+  lock_init (&free_map_lock);
 }
 
-/* Allocates CNT consecutive sectors from the free map and stores
-   the first into *SECTORP.
-   Returns true if successful, false if all sectors were
-   available. */
-bool
-free_map_allocate (size_t cnt, disk_sector_t *sectorp) 
+/* Allocates CNT consecutive sectors from the free map, starting
+   the search at sector START, and stores the first into *SECTORP.
+   Returns true if successful, false if not enough consecutive
+   sectors were available. */
+static bool
+allocate_from (disk_sector_t start, size_t cnt, disk_sector_t *sectorp) 
 {
-  disk_sector_t sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
+  disk_sector_t sector;
+
+  ASSERT (lock_held_by_current_thread (&free_map_lock));
+
+  sector = bitmap_scan_and_flip (free_map, start, cnt, false);
   if (sector != BITMAP_ERROR
       && free_map_file != NULL
       && !bitmap_write (free_map, free_map_file))
@@ -39,13 +46,47 @@ free_map_allocate (size_t cnt, disk_sector_t *sectorp)
   return sector != BITMAP_ERROR;
 }
 
+/* Allocates CNT consecutive sectors from the free map and stores
+   the first into *SECTORP.
+   Returns true if successful, false if all sectors were
+   available. */
+bool
+free_map_allocate (size_t cnt, disk_sector_t *sectorp) 
+{
+  bool success;
+
+  lock_acquire (&free_map_lock);
+  success = allocate_from (0, cnt, sectorp);
+  lock_release (&free_map_lock);
+  return success;
+}
+
+/* Allocates a single sector from the free map and stores it into
+   *SECTORP, preferring the first free sector at or after HINT so
+   that related sectors end up close together.
+   Returns true if successful, false if the disk is full. */
+bool
+free_map_allocate_near (disk_sector_t hint, disk_sector_t *sectorp) 
+{
+  bool success;
+
+  lock_acquire (&free_map_lock);
+  success = ((hint < bitmap_size (free_map)
+              && allocate_from (hint, 1, sectorp))
+             || allocate_from (0, 1, sectorp));
+  lock_release (&free_map_lock);
+  return success;
+}
+
 /* Makes CNT sectors starting at SECTOR available for use. */
 void
 free_map_release (disk_sector_t sector, size_t cnt)
 {
+  lock_acquire (&free_map_lock);
   ASSERT (bitmap_all (free_map, sector, cnt));
   bitmap_set_multiple (free_map, sector, cnt, false);
   bitmap_write (free_map, free_map_file);
+  lock_release (&free_map_lock);
 }
 
 /* Opens the free map file and reads it from disk. */
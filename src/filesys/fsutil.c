@@ -1,5 +1,6 @@
 #include "filesys/fsutil.h"
 #include <debug.h>
+#include <random.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -7,8 +8,11 @@
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "devices/disk.h"
+#include "devices/timer.h"
 #include "threads/malloc.h"
 #include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
 #include "threads/vaddr.h"
 
 /* List files in the root directory. */
@@ -195,3 +199,168 @@ fsutil_get (char **argv)
   file_close (src);
   free (buffer);
 }
+
+/* Creates ARGV[1] files in the root directory, looks each of
+   them up, then deletes them, and prints how long each phase
+   took.  Measures the cost of directory operations as the root
+   directory grows. */
+void
+fsutil_dirbench (char **argv)
+{
+  int file_cnt = atoi (argv[1]);
+  int64_t start;
+  int64_t create_ticks, lookup_ticks, remove_ticks;
+  char name[NAME_MAX + 1];
+  int i;
+
+  if (file_cnt <= 0)
+    PANIC ("dirbench: bad file count '%s'", argv[1]);
+  printf ("Benchmarking directory with %d files...\n", file_cnt);
+
+  start = timer_ticks ();
+  for (i = 0; i < file_cnt; i++)
+    {
+      snprintf (name, sizeof name, "b%d", i);
+      if (!filesys_create (name, 0))
+        PANIC ("%s: create failed", name);
+    }
+  create_ticks = timer_elapsed (start);
+
+  start = timer_ticks ();
+  for (i = 0; i < file_cnt; i++)
+    {
+      struct file *file;
+
+      snprintf (name, sizeof name, "b%d", i);
+      file = filesys_open (name);
+      if (file == NULL)
+        PANIC ("%s: open failed", name);
+      file_close (file);
+    }
+  lookup_ticks = timer_elapsed (start);
+
+  start = timer_ticks ();
+  for (i = 0; i < file_cnt; i++)
+    {
+      snprintf (name, sizeof name, "b%d", i);
+      if (!filesys_remove (name))
+        PANIC ("%s: delete failed", name);
+    }
+  remove_ticks = timer_elapsed (start);
+
+  printf ("dirbench: %d files: create %lld ticks, lookup %lld ticks, "
+          "delete %lld ticks\n",
+          file_cnt, create_ticks, lookup_ticks, remove_ticks);
+}
+
+/* Number of threads run by diskbench, half issuing sequential
+   requests and half random ones, and sectors per request. */
+#define DISKBENCH_THREADS 4
+#define DISKBENCH_SECTORS 8
+
+/* A diskbench thread. */
+struct diskbench
+  {
+    struct disk *disk;          /* Disk to read. */
+    bool sequential;            /* Sequential or random requests? */
+    disk_sector_t start;        /* First sector, if sequential. */
+    int request_cnt;            /* Number of requests to issue. */
+    int64_t *latency;           /* Ticks taken by each request. */
+    struct semaphore *done;     /* Up'd when finished. */
+  };
+
+/* Issues the requests described by DB_, a struct diskbench, and
+   records how long each takes. */
+static void
+diskbench_thread (void *db_)
+{
+  struct diskbench *db = db_;
+  disk_sector_t range = disk_size (db->disk) - DISKBENCH_SECTORS;
+  void *buffer = malloc (DISKBENCH_SECTORS * DISK_SECTOR_SIZE);
+  int i;
+
+  if (buffer == NULL)
+    PANIC ("diskbench: couldn't allocate buffer");
+  for (i = 0; i < db->request_cnt; i++)
+    {
+      disk_sector_t sector;
+      int64_t start;
+
+      if (db->sequential)
+        sector = (db->start + i * DISKBENCH_SECTORS) % range;
+      else
+        sector = random_ulong () % range;
+      start = timer_ticks ();
+      disk_read_multiple (db->disk, sector, DISKBENCH_SECTORS, buffer);
+      db->latency[i] = timer_elapsed (start);
+    }
+  free (buffer);
+  sema_up (db->done);
+}
+
+/* Compares the int64_t values that A and B point to, for
+   qsort(). */
+static int
+compare_int64 (const void *a_, const void *b_)
+{
+  const int64_t *a = a_;
+  const int64_t *b = b_;
+  return *a < *b ? -1 : *a > *b;
+}
+
+/* Reads the scratch disk from several threads at once, half of
+   them sequentially and half at random, ARGV[1] requests per
+   thread, and prints the throughput and the distribution of
+   request latency.  The scratch disk is not modified. */
+void
+fsutil_diskbench (char **argv)
+{
+  struct diskbench db[DISKBENCH_THREADS];
+  struct semaphore done;
+  struct disk *disk;
+  int request_cnt = atoi (argv[1]);
+  int total_cnt = request_cnt * DISKBENCH_THREADS;
+  int64_t *latency;
+  int64_t start, elapsed;
+  int i;
+
+  disk = disk_get (1, 0);
+  if (disk == NULL)
+    PANIC ("couldn't open scratch disk (hdc or hd1:0)");
+  if (request_cnt <= 0)
+    PANIC ("diskbench: bad request count '%s'", argv[1]);
+  latency = malloc (total_cnt * sizeof *latency);
+  if (latency == NULL)
+    PANIC ("diskbench: couldn't allocate latency table");
+
+  printf ("Benchmarking scratch disk with %d threads of %d requests...\n",
+          DISKBENCH_THREADS, request_cnt);
+  sema_init (&done, 0);
+  start = timer_ticks ();
+  for (i = 0; i < DISKBENCH_THREADS; i++)
+    {
+      db[i].disk = disk;
+      db[i].sequential = i % 2 == 0;
+      db[i].start = disk_size (disk) / DISKBENCH_THREADS * i;
+      db[i].request_cnt = request_cnt;
+      db[i].latency = latency + request_cnt * i;
+      db[i].done = &done;
+      thread_create ("diskbench", PRI_DEFAULT, diskbench_thread, &db[i]);
+    }
+  for (i = 0; i < DISKBENCH_THREADS; i++)
+    sema_down (&done);
+  elapsed = timer_elapsed (start);
+
+  qsort (latency, total_cnt, sizeof *latency, compare_int64);
+  printf ("diskbench: %d requests in %lld ticks", total_cnt, elapsed);
+  if (elapsed > 0)
+    printf (", %lld kB/s",
+            (long long) total_cnt * DISKBENCH_SECTORS * DISK_SECTOR_SIZE
+            / 1024 * TIMER_FREQ / elapsed);
+  printf ("\n");
+  printf ("diskbench: latency in ticks: "
+          "median %lld, 90th %lld, 99th %lld, max %lld\n",
+          latency[total_cnt / 2], latency[total_cnt * 90 / 100],
+          latency[total_cnt * 99 / 100], latency[total_cnt - 1]);
+  free (latency);
+}
@@ -6,5 +6,7 @@ void fsutil_cat (char **argv);
 void fsutil_rm (char **argv);
 void fsutil_put (char **argv);
 void fsutil_get (char **argv);
+void fsutil_dirbench (char **argv);
+void fsutil_diskbench (char **argv);
 
 #endif /* filesys/fsutil.h */
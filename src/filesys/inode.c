@@ -1,67 +1,259 @@
 #include "filesys/inode.h"
-#include <list.h>
 #include <debug.h>
+#include <hash.h>
+#include <stdio.h>
 #include <round.h>
 #include <string.h>
+#include "filesys/cache.h"
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
 
+/* Number of sectors to read ahead of a sequential reader. */
+#define READ_AHEAD_SECTORS 8
+
+/* Number of sector pointers held directly in an inode, and in
+   one index block. */
+#define DIRECT_CNT 124
+#define INDEX_CNT (DISK_SECTOR_SIZE / sizeof (disk_sector_t))
+
+/* Largest file size supported, in sectors. */
+#define MAX_SECTORS (DIRECT_CNT + INDEX_CNT + INDEX_CNT * INDEX_CNT)
+
 /* On-disk inode.
-   Must be exactly DISK_SECTOR_SIZE bytes long. */
+   Must be exactly DISK_SECTOR_SIZE bytes long.
+
+   Data sectors are found through DIRECT_CNT direct pointers, then
+   one indirect block of INDEX_CNT pointers, then one doubly
+   indirect block of INDEX_CNT indirect blocks.  A pointer of 0
+   means the sector has not been allocated; such holes read as
+   zeros.  (Sector 0 holds the free map inode, so it is never a
+   data sector.) */
 struct inode_disk
   {
-    disk_sector_t start;                /* First data sector. */
+    disk_sector_t direct[DIRECT_CNT];   /* Direct data sectors. */
+    disk_sector_t indirect;             /* Indirect block. */
+    disk_sector_t doubly_indirect;      /* Doubly indirect block. */
     off_t length;                       /* File size in bytes. */
     unsigned magic;                     /* Magic number. */
-    uint32_t unused[125];               /* Not used. */
   };
 
-/* Returns the number of sectors to allocate for an inode SIZE
-   bytes long. */
-static inline size_t
-bytes_to_sectors (off_t size)
-{
-  return DIV_ROUND_UP (size, DISK_SECTOR_SIZE);
-}
+/* In-memory inode.
 
-/* In-memory inode. */
+   OPEN_CNT, REMOVED and LOADING are protected by
+   open_inodes_lock.  RW
+   guards the file's contents and DATA: reads hold it for
+   reading, so they proceed in parallel, and writes hold it for
+   writing.  READ_POS and AHEAD_POS only steer read-ahead, so
+   concurrent readers update them without further locking.
+   DIR_LOCK is not used by the inode code itself; it makes
+   operations on a directory atomic. */
 struct inode 
   {
-    struct list_elem elem;              /* Element in inode list. */
+    struct hash_elem elem;              /* Element in open_inodes. */
     disk_sector_t sector;               /* Sector number of disk location. */
     int open_cnt;                       /* Number of openers. */
     bool removed;                       /* True if deleted, false otherwise. */
+    bool loading;                       /* DATA still being read? */
     int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
+    off_t read_pos;                     /* Offset just past the last read. */
+    off_t ahead_pos;                    /* Read ahead up to this offset. */
+    disk_sector_t next_alloc;           /* Preferred sector to allocate. */
+    struct rwlock rw;                   /* Readers-writer lock on data. */
+    struct lock dir_lock;               /* Lock for directory operations. */
     struct inode_disk data;             /* Inode content. */
   };
 
+/* Writes INODE's on-disk inode back through the buffer cache. */
+static void
+save_inode (struct inode *inode)
+{
+  cache_write (inode->sector, &inode->data, 0, DISK_SECTOR_SIZE);
+}
+
+/* Allocates a zeroed sector for INODE, as close as possible
+   after the one it allocated last, so that sequentially written
+   files stay mostly contiguous on disk.  Returns the sector, or
+   0 if the disk is full. */
+static disk_sector_t
+allocate_sector (struct inode *inode)
+{
+  static char zeros[DISK_SECTOR_SIZE];
+  disk_sector_t sector;
+
+  if (!free_map_allocate_near (inode->next_alloc, &sector))
+    return 0;
+  cache_write (sector, zeros, 0, DISK_SECTOR_SIZE);
+  inode->next_alloc = sector + 1;
+  return sector;
+}
+
+/* Returns the sector that pointer *SLOTP in INODE's on-disk inode
+   refers to.  If it is 0 and ALLOCATE is true, allocates a sector
+   for it first. */
+static disk_sector_t
+get_direct (struct inode *inode, disk_sector_t *slotp, bool allocate)
+{
+  if (*slotp == 0 && allocate)
+    {
+      *slotp = allocate_sector (inode);
+      if (*slotp != 0)
+        save_inode (inode);
+    }
+  return *slotp;
+}
+
+/* Returns the sector that pointer IDX in index block BLOCK refers
+   to.  If it is 0 and ALLOCATE is true, allocates a sector for it
+   first, on behalf of INODE. */
+static disk_sector_t
+get_indirect (struct inode *inode, disk_sector_t block, size_t idx,
+              bool allocate)
+{
+  disk_sector_t sector;
+
+  ASSERT (idx < INDEX_CNT);
+
+  cache_read (block, &sector, idx * sizeof sector, sizeof sector);
+  if (sector == 0 && allocate)
+    {
+      sector = allocate_sector (inode);
+      if (sector != 0)
+        cache_write (block, &sector, idx * sizeof sector, sizeof sector);
+    }
+  return sector;
+}
+
 /* Returns the disk sector that contains byte offset POS within
-   INODE.
-   Returns -1 if INODE does not contain data for a byte at offset
-   POS. */
+   INODE.  If ALLOCATE is true, allocates that sector and any
+   index blocks leading to it that do not exist yet.
+   Returns 0 if INODE has no sector for the byte at offset POS
+   and ALLOCATE is false, or if allocation fails. */
 static disk_sector_t
-byte_to_sector (const struct inode *inode, off_t pos) 
+byte_to_sector (struct inode *inode, off_t pos, bool allocate) 
 {
+  struct inode_disk *d;
+  size_t idx;
+  disk_sector_t block;
+
   ASSERT (inode != NULL);
-  if (pos < inode->data.length)
-    return inode->data.start + pos / DISK_SECTOR_SIZE;
-  else
-    return -1;
+  ASSERT (pos >= 0);
+
+  d = &inode->data;
+  idx = pos / DISK_SECTOR_SIZE;
+  if (idx < DIRECT_CNT)
+    return get_direct (inode, &d->direct[idx], allocate);
+
+  idx -= DIRECT_CNT;
+  if (idx < INDEX_CNT)
+    {
+      block = get_direct (inode, &d->indirect, allocate);
+      return block != 0 ? get_indirect (inode, block, idx, allocate) : 0;
+    }
+
+  idx -= INDEX_CNT;
+  if (idx < INDEX_CNT * INDEX_CNT)
+    {
+      block = get_direct (inode, &d->doubly_indirect, allocate);
+      if (block != 0)
+        block = get_indirect (inode, block, idx / INDEX_CNT, allocate);
+      return (block != 0
+              ? get_indirect (inode, block, idx % INDEX_CNT, allocate)
+              : 0);
+    }
+
+  return 0;
+}
+
+/* Releases SECTOR, which is an index block with LEVEL levels of
+   indirection below it (0 for a data sector), along with every
+   sector it refers to.  Does nothing if SECTOR is 0. */
+static void
+release_tree (disk_sector_t sector, int level)
+{
+  if (sector == 0)
+    return;
+
+  if (level > 0)
+    {
+      size_t i;
+
+      for (i = 0; i < INDEX_CNT; i++)
+        {
+          disk_sector_t child;
+          cache_read (sector, &child, i * sizeof child, sizeof child);
+          release_tree (child, level - 1);
+        }
+    }
+  free_map_release (sector, 1);
+}
+
+/* Releases every data and index sector of INODE, but not the
+   sector holding the inode itself. */
+static void
+release_sectors (struct inode *inode)
+{
+  struct inode_disk *d = &inode->data;
+  size_t i;
+
+  for (i = 0; i < DIRECT_CNT; i++)
+    release_tree (d->direct[i], 0);
+  release_tree (d->indirect, 1);
+  release_tree (d->doubly_indirect, 2);
+}
+
+/* Table of open inodes, keyed by sector, so that opening a
+   single inode twice returns the same `struct inode'.
+   OPEN_INODES_LOCK protects the table and every inode's
+   OPEN_CNT.  It is not held while an inode is read from disk;
+   the inode is in the table but marked as loading meanwhile,
+   and INODE_LOADED is broadcast once it is read. */
+static struct hash open_inodes;
+static struct lock open_inodes_lock;
+static struct condition inode_loaded;
+
+/* Statistics. */
+static long long open_cnt;              /* Calls to inode_open(). */
+static long long reopen_cnt;            /* ...that found the inode open. */
+static size_t max_open_cnt;             /* Most inodes open at once. */
+
+/* Returns a hash value for inode E. */
+static unsigned
+inode_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct inode *inode = hash_entry (e, struct inode, elem);
+  return hash_int (inode->sector);
 }
 
-/* List of open inodes, so that opening a single inode twice
-   returns the same `struct inode'. */
-static struct list open_inodes;
+/* Returns true if inode A precedes inode B. */
+static bool
+inode_less (const struct hash_elem *a, const struct hash_elem *b,
+            void *aux UNUSED)
+{
+  const struct inode *inode_a = hash_entry (a, struct inode, elem);
+  const struct inode *inode_b = hash_entry (b, struct inode, elem);
+  return inode_a->sector < inode_b->sector;
+}
 
 /* Initializes the inode module. */
 void
 inode_init (void) 
 {
-  list_init (&open_inodes);
+  hash_init (&open_inodes, inode_hash, inode_less, NULL);
+  lock_init (&open_inodes_lock);
+  cond_init (&inode_loaded);
+}
+
+/* Prints statistics about the open inode table. */
+void
+inode_print_stats (void)
+{
+  printf ("Inodes: %lld opens (%lld already open), %zu open at most\n",
+          open_cnt, reopen_cnt, max_open_cnt);
 }
 
 /* Initializes an inode with LENGTH bytes of data and
@@ -73,7 +265,9 @@ bool
 inode_create (disk_sector_t sector, off_t length)
 {
   struct inode_disk *disk_inode = NULL;
-  bool success = false;
+  struct inode *inode;
+  bool success = true;
+  off_t ofs;
 
   ASSERT (length >= 0);
 
@@ -81,27 +275,33 @@ inode_create (disk_sector_t sector, off_t length)
      one sector in size, and you should fix that. */
   ASSERT (sizeof *disk_inode == DISK_SECTOR_SIZE);
 
+  if ((size_t) DIV_ROUND_UP (length, DISK_SECTOR_SIZE) > MAX_SECTORS)
+    return false;
+
+  /* Write an empty inode, then allocate its initial sectors
+     through the regular growth path. */
   disk_inode = calloc (1, sizeof *disk_inode);
-  if (disk_inode != NULL)
+  if (disk_inode == NULL)
+    return false;
+  disk_inode->length = 0;
+  disk_inode->magic = INODE_MAGIC;
+  cache_write (sector, disk_inode, 0, DISK_SECTOR_SIZE);
+  free (disk_inode);
+
+  inode = inode_open (sector);
+  if (inode == NULL)
+    return false;
+  for (ofs = 0; ofs < length && success; ofs += DISK_SECTOR_SIZE)
+    success = byte_to_sector (inode, ofs, true) != 0;
+  if (success)
     {
-      size_t sectors = bytes_to_sectors (length);
-      disk_inode->length = length;
-      disk_inode->magic = INODE_MAGIC;
-      if (free_map_allocate (sectors, &disk_inode->start))
-        {
-          disk_write (filesys_disk, sector, disk_inode);
-          if (sectors > 0) 
-            {
-              static char zeros[DISK_SECTOR_SIZE];
-              size_t i;
-              
-              for (i = 0; i < sectors; i++) 
-                disk_write (filesys_disk, disk_inode->start + i, zeros); 
-            }
-          success = true; 
-        } 
-      free (disk_inode);
+      inode->data.length = length;
+      save_inode (inode);
     }
+  else
+    release_sectors (inode);
+  inode_close (inode);
+
   return success;
 }
 
@@ -111,33 +311,60 @@ inode_create (disk_sector_t sector, off_t length)
 struct inode *
 inode_open (disk_sector_t sector) 
 {
-  struct list_elem *e;
+  struct inode key;
+  struct hash_elem *e;
   struct inode *inode;
 
+  lock_acquire (&open_inodes_lock);
+  open_cnt++;
+
   /* Check whether this inode is already open. */
-  for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
-       e = list_next (e)) 
+  key.sector = sector;
+  e = hash_find (&open_inodes, &key.elem);
+  if (e != NULL)
     {
-      inode = list_entry (e, struct inode, elem);
-      if (inode->sector == sector) 
-        {
-          inode_reopen (inode);
-          return inode; 
-        }
+      inode = hash_entry (e, struct inode, elem);
+      inode->open_cnt++;
+      reopen_cnt++;
+      while (inode->loading)
+        cond_wait (&inode_loaded, &open_inodes_lock);
+      lock_release (&open_inodes_lock);
+      return inode;
     }
 
   /* Allocate memory. */
   inode = malloc (sizeof *inode);
   if (inode == NULL)
-    return NULL;
+    {
+      lock_release (&open_inodes_lock);
+      return NULL;
+    }
 
-  /* Initialize. */
-  list_push_front (&open_inodes, &inode->elem);
+  /* Initialize.  The on-disk inode is read without the lock
+     held, so that other opens and closes do not wait for the
+     disk; a concurrent opener of the same inode waits for
+     LOADING to clear instead of seeing it half-filled. */
   inode->sector = sector;
   inode->open_cnt = 1;
   inode->deny_write_cnt = 0;
   inode->removed = false;
-  disk_read (filesys_disk, inode->sector, &inode->data);
+  inode->loading = true;
+  inode->read_pos = 0;
+  inode->ahead_pos = 0;
+  inode->next_alloc = sector + 1;
+  rw_init (&inode->rw);
+  lock_init (&inode->dir_lock);
+  hash_insert (&open_inodes, &inode->elem);
+  if (hash_size (&open_inodes) > max_open_cnt)
+    max_open_cnt = hash_size (&open_inodes);
+  lock_release (&open_inodes_lock);
+
+  cache_read (inode->sector, &inode->data, 0, DISK_SECTOR_SIZE);
+
+  lock_acquire (&open_inodes_lock);
+  inode->loading = false;
+  cond_broadcast (&inode_loaded, &open_inodes_lock);
+  lock_release (&open_inodes_lock);
   return inode;
 }
 
@@ -146,7 +373,11 @@ struct inode *
 inode_reopen (struct inode *inode)
 {
   if (inode != NULL)
-    inode->open_cnt++;
+    {
+      lock_acquire (&open_inodes_lock);
+      inode->open_cnt++;
+      lock_release (&open_inodes_lock);
+    }
   return inode;
 }
 
@@ -168,21 +399,24 @@ inode_close (struct inode *inode)
     return;
 
   /* Release resources if this was the last opener. */
+  lock_acquire (&open_inodes_lock);
   if (--inode->open_cnt == 0)
     {
-      /* Remove from inode list and release lock. */
-      list_remove (&inode->elem);
+      /* Remove from inode table and release lock. */
+      hash_delete (&open_inodes, &inode->elem);
+      lock_release (&open_inodes_lock);
  
       /* Deallocate blocks if removed. */
       if (inode->removed) 
         {
           free_map_release (inode->sector, 1);
-          free_map_release (inode->data.start,
-                            bytes_to_sectors (inode->data.length)); 
+          release_sectors (inode);
         }
 
       free (inode); 
     }
+  else
+    lock_release (&open_inodes_lock);
 }
 
 /* Marks INODE to be deleted when it is closed by the last caller who
@@ -191,7 +425,47 @@ void
 inode_remove (struct inode *inode) 
 {
   ASSERT (inode != NULL);
+  lock_acquire (&open_inodes_lock);
   inode->removed = true;
+  lock_release (&open_inodes_lock);
+}
+
+/* Acquires INODE's directory lock, which serializes lookups and
+   updates of the directory that INODE holds. */
+void
+inode_lock (struct inode *inode)
+{
+  lock_acquire (&inode->dir_lock);
+}
+
+/* Releases INODE's directory lock. */
+void
+inode_unlock (struct inode *inode)
+{
+  lock_release (&inode->dir_lock);
+}
+
+/* Asks the buffer cache to read ahead the sectors of INODE that
+   follow byte offset POS, where a sequential reader will look
+   next.  Sectors already requested are not requested again. */
+static void
+read_ahead (struct inode *inode, off_t pos)
+{
+  off_t end = pos + READ_AHEAD_SECTORS * DISK_SECTOR_SIZE;
+  off_t ofs = ROUND_UP (pos, DISK_SECTOR_SIZE);
+
+  if (ofs < inode->ahead_pos)
+    ofs = inode->ahead_pos;
+  if (end > inode_length (inode))
+    end = inode_length (inode);
+  for (; ofs < end; ofs += DISK_SECTOR_SIZE)
+    {
+      disk_sector_t sector = byte_to_sector (inode, ofs, false);
+      if (sector != 0)
+        cache_read_ahead (sector);
+    }
+  if (ofs > inode->ahead_pos)
+    inode->ahead_pos = ofs;
 }
 
 /* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
@@ -202,12 +476,20 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
 {
   uint8_t *buffer = buffer_;
   off_t bytes_read = 0;
-  uint8_t *bounce = NULL;
+  bool sequential;
+
+  rw_acquire_read (&inode->rw);
+  sequential = offset == inode->read_pos;
+
+  /* A reader that jumped elsewhere invalidates the read-ahead
+     window. */
+  if (!sequential)
+    inode->ahead_pos = 0;
 
   while (size > 0) 
     {
       /* Disk sector to read, starting byte offset within sector. */
-      disk_sector_t sector_idx = byte_to_sector (inode, offset);
+      disk_sector_t sector_idx = byte_to_sector (inode, offset, false);
       int sector_ofs = offset % DISK_SECTOR_SIZE;
 
       /* Bytes left in inode, bytes left in sector, lesser of the two. */
@@ -220,99 +502,76 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
       if (chunk_size <= 0)
         break;
 
-      if (sector_ofs == 0 && chunk_size == DISK_SECTOR_SIZE) 
-        {
-          /* Read full sector directly into caller's buffer. */
-          disk_read (filesys_disk, sector_idx, buffer + bytes_read); 
-        }
-      else 
-        {
-          /* Read sector into bounce buffer, then partially copy
-             into caller's buffer. */
-          if (bounce == NULL) 
-            {
-              bounce = malloc (DISK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
-            }
-          disk_read (filesys_disk, sector_idx, bounce);
-          memcpy (buffer + bytes_read, bounce + sector_ofs, chunk_size);
-        }
+      /* Sectors never written read as zeros. */
+      if (sector_idx != 0)
+        cache_read (sector_idx, buffer + bytes_read, sector_ofs, chunk_size);
+      else
+        memset (buffer + bytes_read, 0, chunk_size);
       
       /* Advance. */
       size -= chunk_size;
       offset += chunk_size;
       bytes_read += chunk_size;
     }
-  free (bounce);
+
+  inode->read_pos = offset;
+  if (sequential && bytes_read > 0)
+    read_ahead (inode, offset);
+  rw_release_read (&inode->rw);
 
   return bytes_read;
 }
 
 /* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
    Returns the number of bytes actually written, which may be
-   less than SIZE if end of file is reached or an error occurs.
-   (Normally a write at end of file would extend the inode, but
-   growth is not yet implemented.) */
+   less than SIZE if the disk fills up or the file reaches its
+   maximum size.  Writing past end of file extends the inode,
+   allocating sectors as they are first written. */
 off_t
 inode_write_at (struct inode *inode, const void *buffer_, off_t size,
                 off_t offset) 
 {
   const uint8_t *buffer = buffer_;
   off_t bytes_written = 0;
-  uint8_t *bounce = NULL;
 
+  rw_acquire_write (&inode->rw);
   if (inode->deny_write_cnt)
-    return 0;
+    {
+      rw_release_write (&inode->rw);
+      return 0;
+    }
 
   while (size > 0) 
     {
       /* Sector to write, starting byte offset within sector. */
-      disk_sector_t sector_idx = byte_to_sector (inode, offset);
+      disk_sector_t sector_idx = byte_to_sector (inode, offset, true);
       int sector_ofs = offset % DISK_SECTOR_SIZE;
 
-      /* Bytes left in inode, bytes left in sector, lesser of the two. */
-      off_t inode_left = inode_length (inode) - offset;
+      /* Bytes left in sector. */
       int sector_left = DISK_SECTOR_SIZE - sector_ofs;
-      int min_left = inode_left < sector_left ? inode_left : sector_left;
 
       /* Number of bytes to actually write into this sector. */
-      int chunk_size = size < min_left ? size : min_left;
-      if (chunk_size <= 0)
+      int chunk_size = size < sector_left ? size : sector_left;
+      if (sector_idx == 0)
         break;
 
-      if (sector_ofs == 0 && chunk_size == DISK_SECTOR_SIZE) 
-        {
-          /* Write full sector directly to disk. */
-          disk_write (filesys_disk, sector_idx, buffer + bytes_written); 
-        }
-      else 
-        {
-          /* We need a bounce buffer. */
-          if (bounce == NULL) 
-            {
-              bounce = malloc (DISK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
-            }
-
-          /* If the sector contains data before or after the chunk
-             we're writing, then we need to read in the sector
-             first.  Otherwise we start with a sector of all zeros. */
-          if (sector_ofs > 0 || chunk_size < sector_left) 
-            disk_read (filesys_disk, sector_idx, bounce);
-          else
-            memset (bounce, 0, DISK_SECTOR_SIZE);
-          memcpy (bounce + sector_ofs, buffer + bytes_written, chunk_size);
-          disk_write (filesys_disk, sector_idx, bounce); 
-        }
+      cache_write (sector_idx, buffer + bytes_written, sector_ofs,
+                   chunk_size);
 
       /* Advance. */
       size -= chunk_size;
       offset += chunk_size;
       bytes_written += chunk_size;
     }
-  free (bounce);
+
+  /* Extend the file once its new data is in place, so that
+     readers never see the new length before the data. */
+  if (offset > inode->data.length)
+    {
+      inode->data.length = offset;
+      save_inode (inode);
+    }
+  rw_release_write (&inode->rw);
 
   return bytes_written;
 }
@@ -322,8 +581,10 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 void
 inode_deny_write (struct inode *inode) 
 {
+  rw_acquire_write (&inode->rw);
   inode->deny_write_cnt++;
   ASSERT (inode->deny_write_cnt <= inode->open_cnt);
+  rw_release_write (&inode->rw);
 }
 
 /* Re-enables writes to INODE.
@@ -332,12 +593,16 @@ inode_deny_write (struct inode *inode)
 void
 inode_allow_write (struct inode *inode) 
 {
+  rw_acquire_write (&inode->rw);
   ASSERT (inode->deny_write_cnt > 0);
   ASSERT (inode->deny_write_cnt <= inode->open_cnt);
   inode->deny_write_cnt--;
+  rw_release_write (&inode->rw);
 }
 
-/* Returns the length, in bytes, of INODE's data. */
+/* Returns the length, in bytes, of INODE's data.  Reads the
+   length without locking; a write that extends the file updates
+   it in a single store, after the new data is in place. */
 off_t
 inode_length (const struct inode *inode)
 {
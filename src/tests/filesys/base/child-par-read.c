@@ -0,0 +1,46 @@
+/* Child process for par-read and par-read-serial tests.
+   Reads its file from start to end READ_CNT times, a sector at a
+   time, checking the contents as it goes. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/filesys/base/par-read.h"
+
+const char *test_name = "child-par-read";
+
+int
+main (int argc, const char *argv[]) 
+{
+  char file_name[16];
+  char block[512];
+  int child_idx;
+  int fd;
+  int i;
+  size_t ofs, j;
+
+  quiet = true;
+  
+  CHECK (argc == 2, "argc must be 2, actually %d", argc);
+  child_idx = atoi (argv[1]);
+  snprintf (file_name, sizeof file_name, "par%d", child_idx);
+
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  for (i = 0; i < READ_CNT; i++)
+    {
+      seek (fd, 0);
+      for (ofs = 0; ofs < FILE_SIZE; ofs += sizeof block)
+        {
+          CHECK (read (fd, block, sizeof block) == sizeof block,
+                 "read \"%s\"", file_name);
+          for (j = 0; j < sizeof block; j++)
+            if (block[j] != par_read_byte (child_idx, ofs + j))
+              fail ("byte %zu of \"%s\" differs from expected",
+                    ofs + j, file_name);
+        }
+    }
+  close (fd);
+
+  return child_idx;
+}
@@ -0,0 +1,42 @@
+/* Child process for syn-open test.
+   Opens each of its FILE_CNT files twice, keeping them all open
+   until the end, so that the first open of each file adds a new
+   inode to the open inode table and the second finds it there. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/filesys/base/syn-open.h"
+
+const char *test_name = "child-syn-open";
+
+static int fds[FILE_CNT][2];
+
+int
+main (int argc, const char *argv[]) 
+{
+  char file_name[16];
+  int child_idx;
+  int i, j;
+
+  quiet = true;
+  
+  CHECK (argc == 2, "argc must be 2, actually %d", argc);
+  child_idx = atoi (argv[1]);
+
+  for (j = 0; j < 2; j++)
+    for (i = 0; i < FILE_CNT; i++)
+      {
+        snprintf (file_name, sizeof file_name, "f%d-%d", child_idx, i);
+        CHECK ((fds[i][j] = open (file_name)) > 1,
+               "open \"%s\"", file_name);
+      }
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      close (fds[i][0]);
+      close (fds[i][1]);
+    }
+
+  return child_idx;
+}
@@ -0,0 +1,5 @@
+/* Runs par-read with the kernel's -serialfs option, which makes
+   every file system call take a single global lock.  Compare the
+   run time with that of par-read. */
+
+#include "tests/filesys/base/par-read.inc"
@@ -0,0 +1,33 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(par-read-serial) begin
+(par-read-serial) create "par0"
+(par-read-serial) open "par0"
+(par-read-serial) write "par0"
+(par-read-serial) close "par0"
+(par-read-serial) create "par1"
+(par-read-serial) open "par1"
+(par-read-serial) write "par1"
+(par-read-serial) close "par1"
+(par-read-serial) create "par2"
+(par-read-serial) open "par2"
+(par-read-serial) write "par2"
+(par-read-serial) close "par2"
+(par-read-serial) create "par3"
+(par-read-serial) open "par3"
+(par-read-serial) write "par3"
+(par-read-serial) close "par3"
+(par-read-serial) exec child 1 of 4: "child-par-read 0"
+(par-read-serial) exec child 2 of 4: "child-par-read 1"
+(par-read-serial) exec child 3 of 4: "child-par-read 2"
+(par-read-serial) exec child 4 of 4: "child-par-read 3"
+(par-read-serial) wait for child 1 of 4 returned 0 (expected 0)
+(par-read-serial) wait for child 2 of 4 returned 1 (expected 1)
+(par-read-serial) wait for child 3 of 4 returned 2 (expected 2)
+(par-read-serial) wait for child 4 of 4 returned 3 (expected 3)
+(par-read-serial) end
+EOF
+pass;
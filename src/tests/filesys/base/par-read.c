@@ -0,0 +1,6 @@
+/* Spawns several child processes, each of which reads its own
+   file a few times over.  Since the files are unrelated, the
+   reads may proceed in parallel; compare the run time with that
+   of par-read-serial. */
+
+#include "tests/filesys/base/par-read.inc"
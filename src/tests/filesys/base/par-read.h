@@ -0,0 +1,16 @@
+#ifndef TESTS_FILESYS_BASE_PAR_READ_H
+#define TESTS_FILESYS_BASE_PAR_READ_H
+
+#define CHILD_CNT 4
+#define FILE_SIZE 65536
+#define READ_CNT 4
+
+/* Returns the byte at offset OFS in the file read by child
+   CHILD_IDX. */
+static inline char
+par_read_byte (int child_idx, size_t ofs)
+{
+  return (ofs * 7 + child_idx) & 0xff;
+}
+
+#endif /* tests/filesys/base/par-read.h */
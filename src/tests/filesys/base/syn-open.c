@@ -0,0 +1,33 @@
+/* Creates FILE_CNT files for each of CHILD_CNT child processes,
+   which then all open their own files at the same time.  This
+   puts hundreds of distinct inodes in the kernel's open inode
+   table at once.  Pintos offers user programs no clock, so the
+   open latency shows up in the kernel's inode statistics and
+   tick count at power off. */
+
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+#include "tests/filesys/base/syn-open.h"
+
+void
+test_main (void) 
+{
+  pid_t children[CHILD_CNT];
+  char file_name[16];
+  int i, j;
+
+  quiet = true;
+  for (i = 0; i < CHILD_CNT; i++)
+    for (j = 0; j < FILE_CNT; j++)
+      {
+        snprintf (file_name, sizeof file_name, "f%d-%d", i, j);
+        CHECK (create (file_name, 0), "create \"%s\"", file_name);
+      }
+  quiet = false;
+  msg ("created %d files", CHILD_CNT * FILE_CNT);
+
+  exec_children ("child-syn-open", children, CHILD_CNT);
+  wait_children (children, CHILD_CNT);
+}
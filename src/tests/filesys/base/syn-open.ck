@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(syn-open) begin
+(syn-open) created 400 files
+(syn-open) exec child 1 of 4: "child-syn-open 0"
+(syn-open) exec child 2 of 4: "child-syn-open 1"
+(syn-open) exec child 3 of 4: "child-syn-open 2"
+(syn-open) exec child 4 of 4: "child-syn-open 3"
+(syn-open) wait for child 1 of 4 returned 0 (expected 0)
+(syn-open) wait for child 2 of 4 returned 1 (expected 1)
+(syn-open) wait for child 3 of 4 returned 2 (expected 2)
+(syn-open) wait for child 4 of 4 returned 3 (expected 3)
+(syn-open) end
+EOF
+pass;
@@ -0,0 +1,7 @@
+#ifndef TESTS_FILESYS_BASE_SYN_OPEN_H
+#define TESTS_FILESYS_BASE_SYN_OPEN_H
+
+#define CHILD_CNT 4
+#define FILE_CNT 100
+
+#endif /* tests/filesys/base/syn-open.h */
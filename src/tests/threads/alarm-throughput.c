@@ -0,0 +1,78 @@
+/* Measures how much work the main thread gets done in a fixed
+   number of ticks, first alone and then with SLEEPER_CNT
+   threads asleep in timer_sleep() the whole time.  Sleeping
+   threads should cost no CPU time, so the second run should get
+   about as much done as the first. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define SLEEPER_CNT 100
+#define SPIN_TICKS 50
+
+static void sleeper (void *);
+static long long spin (int64_t ticks);
+
+void
+test_alarm_throughput (void) 
+{
+  struct semaphore done;
+  long long alone, crowded;
+  int i;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  alone = spin (SPIN_TICKS);
+
+  sema_init (&done, 0);
+  for (i = 0; i < SLEEPER_CNT; i++)
+    {
+      char name[16];
+      snprintf (name, sizeof name, "sleeper %d", i);
+      thread_create (name, PRI_DEFAULT, sleeper, &done);
+    }
+
+  /* Let the sleepers fall asleep. */
+  timer_sleep (2);
+  crowded = spin (SPIN_TICKS);
+
+  for (i = 0; i < SLEEPER_CNT; i++)
+    sema_down (&done);
+  msg ("%d sleepers woke up", SLEEPER_CNT);
+
+  if (crowded < alone / 2)
+    fail ("%lld loops with %d sleepers, but %lld loops alone",
+          crowded, SLEEPER_CNT, alone);
+  msg ("throughput with sleepers is at least half of that alone");
+}
+
+/* Sleeps through the second measurement, then ups DONE_. */
+static void
+sleeper (void *done_) 
+{
+  struct semaphore *done = done_;
+
+  timer_sleep (SPIN_TICKS * 2);
+  sema_up (done);
+}
+
+/* Returns the number of loops run in TICKS timer ticks, counted
+   from the start of a tick. */
+static long long
+spin (int64_t ticks) 
+{
+  int64_t start = timer_ticks ();
+  long long loops = 0;
+
+  while (timer_ticks () == start)
+    continue;
+  start = timer_ticks ();
+  while (timer_elapsed (start) < ticks)
+    loops++;
+  return loops;
+}
@@ -0,0 +1,11 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(alarm-throughput) begin
+(alarm-throughput) 100 sleepers woke up
+(alarm-throughput) throughput with sleepers is at least half of that alone
+(alarm-throughput) end
+EOF
+pass;
@@ -0,0 +1,75 @@
+/* Runs THREAD_CNT threads that each increment a shared counter
+   ITER_CNT times under a lock, on a machine with at least two
+   processors.  Checks that the threads ran on more than one
+   processor and that no increment was lost, that is, that locks
+   still exclude each other when their holders run in parallel. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/smp.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+#define THREAD_CNT 4
+#define ITER_CNT 100000
+
+static struct lock counter_lock;
+static long long counter;
+static bool ran_on[CPU_MAX];
+
+static void counter_thread (void *);
+
+void
+test_smp_parallel (void) 
+{
+  struct semaphore done;
+  unsigned cpus_used;
+  unsigned i;
+
+  if (cpu_cnt < 2)
+    fail ("%u processor(s), but this test needs at least 2", cpu_cnt);
+
+  lock_init (&counter_lock);
+  sema_init (&done, 0);
+  for (i = 0; i < THREAD_CNT; i++)
+    {
+      char name[16];
+      snprintf (name, sizeof name, "counter %u", i);
+      thread_create (name, PRI_DEFAULT, counter_thread, &done);
+    }
+  for (i = 0; i < THREAD_CNT; i++)
+    sema_down (&done);
+
+  if (counter != (long long) THREAD_CNT * ITER_CNT)
+    fail ("counter is %lld, should be %lld",
+          counter, (long long) THREAD_CNT * ITER_CNT);
+  msg ("%d threads counted to %lld", THREAD_CNT,
+       (long long) THREAD_CNT * ITER_CNT);
+
+  cpus_used = 0;
+  for (i = 0; i < cpu_cnt; i++)
+    if (ran_on[i])
+      cpus_used++;
+  if (cpus_used < 2)
+    fail ("all threads ran on one processor");
+  msg ("threads ran on more than one processor");
+}
+
+/* Increments COUNTER ITER_CNT times, noting the processor it
+   runs on each time, then ups DONE_. */
+static void
+counter_thread (void *done_) 
+{
+  struct semaphore *done = done_;
+  int i;
+
+  for (i = 0; i < ITER_CNT; i++)
+    {
+      lock_acquire (&counter_lock);
+      counter++;
+      ran_on[cpu_current ()->id] = true;
+      lock_release (&counter_lock);
+    }
+  sema_up (done);
+}
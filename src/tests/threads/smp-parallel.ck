@@ -0,0 +1,11 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(smp-parallel) begin
+(smp-parallel) 4 threads counted to 400000
+(smp-parallel) threads ran on more than one processor
+(smp-parallel) end
+EOF
+pass;
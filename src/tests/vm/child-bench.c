@@ -0,0 +1,10 @@
+/* Child process of exec-bench.
+   Exits at once with the value given as its argument. */
+
+#include <stdlib.h>
+
+int
+main (int argc, char *argv[])
+{
+  return argc > 1 ? atoi (argv[1]) : -1;
+}
@@ -0,0 +1,35 @@
+/* Child process of page-scale.
+   Writes the first N kB of a 512 kB buffer, N given as its
+   argument, one page at a time, then reads them back twice.
+   Large children keep the swap disk busy; small ones only take
+   faults on pages that need no I/O. */
+
+#include <stdlib.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+const char *test_name = "child-scale";
+
+#define PAGE_SIZE 4096
+#define SIZE (512 * 1024)
+static char buf[SIZE];
+
+int
+main (int argc, char *argv[])
+{
+  size_t size, i;
+  int pass;
+
+  size = argc > 1 ? atoi (argv[1]) * 1024 : 0;
+  if (size > SIZE)
+    size = SIZE;
+
+  for (i = 0; i < size; i += PAGE_SIZE)
+    buf[i] = i / PAGE_SIZE;
+  for (pass = 0; pass < 2; pass++)
+    for (i = 0; i < size; i += PAGE_SIZE)
+      if (buf[i] != (char) (i / PAGE_SIZE))
+        fail ("byte %zu is wrong", i);
+
+  return 0x42;
+}
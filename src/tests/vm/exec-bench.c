@@ -0,0 +1,33 @@
+/* Starts SPAWN_CNT children one after another with exec, each of
+   which exits at once.  Compare the run time with that of
+   fork-bench. */
+
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+#include "tests/vm/spawn-bench.h"
+
+static char buf[SPAWN_BUF_SIZE];
+
+void
+test_main (void)
+{
+  char cmd_line[32];
+  int i;
+
+  memset (buf, 0x5a, sizeof buf);
+  for (i = 0; i < SPAWN_CNT; i++)
+    {
+      pid_t pid;
+
+      snprintf (cmd_line, sizeof cmd_line, "child-bench %d", i);
+      pid = exec (cmd_line);
+      if (pid == PID_ERROR)
+        fail ("exec \"%s\" failed", cmd_line);
+      if (wait (pid) != i)
+        fail ("child %d returned the wrong value", i);
+    }
+  msg ("executed %d children", SPAWN_CNT);
+}
@@ -0,0 +1,10 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(exec-bench) begin
+(exec-bench) executed 32 children
+(exec-bench) end
+EOF
+pass;
@@ -0,0 +1,31 @@
+/* Starts SPAWN_CNT children one after another with fork, each of
+   which exits at once.  Compare the run time with that of
+   exec-bench, which starts the same number of children with
+   exec. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+#include "tests/vm/spawn-bench.h"
+
+static char buf[SPAWN_BUF_SIZE];
+
+void
+test_main (void)
+{
+  int i;
+
+  memset (buf, 0x5a, sizeof buf);
+  for (i = 0; i < SPAWN_CNT; i++)
+    {
+      pid_t pid = fork ();
+      if (pid == 0)
+        exit (i);
+      if (pid == PID_ERROR)
+        fail ("fork %d failed", i);
+      if (wait (pid) != i)
+        fail ("child %d returned the wrong value", i);
+    }
+  msg ("forked %d children", SPAWN_CNT);
+}
@@ -0,0 +1,10 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(fork-bench) begin
+(fork-bench) forked 32 children
+(fork-bench) end
+EOF
+pass;
@@ -0,0 +1,43 @@
+/* Forks a child that overwrites a buffer it inherited, and checks
+   that parent and child each see only their own writes. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (64 * 1024)
+
+static char buf[SIZE];
+
+static void
+check_buf (char value, const char *who)
+{
+  size_t i;
+
+  for (i = 0; i < SIZE; i++)
+    if (buf[i] != value)
+      fail ("%s: byte %zu is 0x%02x, not 0x%02x",
+            who, i, buf[i] & 0xff, value & 0xff);
+}
+
+void
+test_main (void)
+{
+  pid_t pid;
+
+  memset (buf, 0x5a, sizeof buf);
+
+  pid = fork ();
+  if (pid == 0)
+    {
+      check_buf (0x5a, "child");
+      memset (buf, 0xa5, sizeof buf);
+      check_buf (0xa5, "child");
+      exit (81);
+    }
+  CHECK (pid > 0, "fork");
+  CHECK (wait (pid) == 81, "wait for child");
+  check_buf (0x5a, "parent");
+  msg ("parent's buffer is unchanged");
+}
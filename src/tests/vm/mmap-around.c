@@ -0,0 +1,66 @@
+/* Maps a file and reads it front to back, so that later faults
+   map several pages at once, then back to front, so that they
+   map none.  Writes through the mapping in between and checks
+   that the file holds the writes after unmapping, including
+   those to pages that were mapped ahead of a fault. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ACTUAL ((void *) 0x10000000)
+#define PAGE_CNT 64
+#define MAP_SIZE (PAGE_CNT * 4096)
+
+static char buf[4096];
+
+void
+test_main (void)
+{
+  char *map_base = ACTUAL;
+  int handle;
+  mapid_t map;
+  size_t i, page;
+
+  CHECK (create ("around", 0), "create \"around\"");
+  CHECK ((handle = open ("around")) > 1, "open \"around\"");
+  for (page = 0; page < PAGE_CNT; page++)
+    {
+      memset (buf, page, sizeof buf);
+      if (write (handle, buf, sizeof buf) != sizeof buf)
+        fail ("write of page %zu failed", page);
+    }
+  msg ("write %d pages", PAGE_CNT);
+  CHECK ((map = mmap (handle, ACTUAL)) != MAP_FAILED, "mmap \"around\"");
+
+  for (i = 0; i < MAP_SIZE; i++)
+    if (map_base[i] != (char) (i / 4096))
+      fail ("byte %zu of mapping is wrong", i);
+  msg ("read mapping forward");
+
+  for (page = 0; page < PAGE_CNT; page++)
+    map_base[page * 4096 + 1] = 0x5a;
+  msg ("write mapping");
+
+  for (i = MAP_SIZE; i-- > 0; )
+    {
+      char expected = i % 4096 == 1 ? 0x5a : (char) (i / 4096);
+      if (map_base[i] != expected)
+        fail ("byte %zu of mapping is wrong", i);
+    }
+  msg ("read mapping backward");
+  munmap (map);
+
+  for (page = 0; page < PAGE_CNT; page++)
+    {
+      seek (handle, page * 4096);
+      if (read (handle, buf, sizeof buf) != sizeof buf)
+        fail ("read of page %zu failed", page);
+      for (i = 0; i < sizeof buf; i++)
+        if (buf[i] != (i == 1 ? 0x5a : (char) page))
+          fail ("byte %zu of file is wrong", page * 4096 + i);
+    }
+  msg ("compare file against written data");
+  close (handle);
+}
@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(mmap-around) begin
+(mmap-around) create "around"
+(mmap-around) open "around"
+(mmap-around) write 64 pages
+(mmap-around) mmap "around"
+(mmap-around) read mapping forward
+(mmap-around) write mapping
+(mmap-around) read mapping backward
+(mmap-around) compare file against written data
+(mmap-around) end
+EOF
+pass;
@@ -0,0 +1,58 @@
+/* Writes to a file through a mapping, then touches enough
+   anonymous memory to force the mapped pages out.  Checks that
+   the mapping still reads back what was written, which it must
+   refault from the file if the pages were evicted, and then
+   that the file holds the data after unmapping. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ACTUAL ((void *) 0x10000000)
+#define MAP_SIZE (64 * 1024)
+#define SIZE (2 * 1024 * 1024)
+
+static char buf[SIZE];
+static char check[1024];
+
+void
+test_main (void)
+{
+  char *map_base = ACTUAL;
+  int handle;
+  mapid_t map;
+  size_t i, ofs;
+
+  CHECK (create ("evict", MAP_SIZE), "create \"evict\"");
+  CHECK ((handle = open ("evict")) > 1, "open \"evict\"");
+  CHECK ((map = mmap (handle, ACTUAL)) != MAP_FAILED, "mmap \"evict\"");
+
+  msg ("write mapping");
+  for (i = 0; i < MAP_SIZE; i++)
+    map_base[i] = i * 7;
+
+  /* Push the mapping out of memory. */
+  msg ("touch %d kB of memory", SIZE / 1024);
+  memset (buf, 0x5a, sizeof buf);
+
+  /* Read back through the mapping. */
+  for (i = 0; i < MAP_SIZE; i++)
+    if (map_base[i] != (char) (i * 7))
+      fail ("byte %zu of mapping is wrong", i);
+  msg ("compare mapping against written data");
+  munmap (map);
+
+  /* Read back via read(). */
+  for (ofs = 0; ofs < MAP_SIZE; ofs += sizeof check)
+    {
+      seek (handle, ofs);
+      if (read (handle, check, sizeof check) != sizeof check)
+        fail ("read of %zu bytes at offset %zu failed", sizeof check, ofs);
+      for (i = 0; i < sizeof check; i++)
+        if (check[i] != (char) ((ofs + i) * 7))
+          fail ("byte %zu of file is wrong", ofs + i);
+    }
+  msg ("compare file against written data");
+  close (handle);
+}
@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(mmap-evict) begin
+(mmap-evict) create "evict"
+(mmap-evict) open "evict"
+(mmap-evict) mmap "evict"
+(mmap-evict) write mapping
+(mmap-evict) touch 2048 kB of memory
+(mmap-evict) compare mapping against written data
+(mmap-evict) compare file against written data
+(mmap-evict) end
+EOF
+pass;
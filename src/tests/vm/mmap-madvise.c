@@ -0,0 +1,89 @@
+/* Gives each kind of madvise() advice for a mapping and checks
+   that the mapping and the file keep the right contents: pages
+   read in ahead by MADV_WILLNEED, pages written back and dropped
+   by MADV_DONTNEED, and pages dropped behind a MADV_SEQUENTIAL
+   reader must all read back what was written. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ACTUAL ((void *) 0x10000000)
+#define PAGE_CNT 64
+#define MAP_SIZE (PAGE_CNT * 4096)
+
+static char buf[4096];
+
+/* Checks that every page of the mapping holds its page number,
+   except for byte 1, which holds MARK. */
+static void
+check_mapping (const char *map_base, char mark, bool forward)
+{
+  size_t page, i;
+
+  for (page = 0; page < PAGE_CNT; page++)
+    {
+      size_t p = forward ? page : PAGE_CNT - 1 - page;
+      for (i = 0; i < 4096; i++)
+        if (map_base[p * 4096 + i] != (i == 1 ? mark : (char) p))
+          fail ("byte %zu of mapping is wrong", p * 4096 + i);
+    }
+}
+
+void
+test_main (void)
+{
+  char *map_base = ACTUAL;
+  int handle;
+  mapid_t map;
+  size_t page, i;
+
+  CHECK (create ("advised", 0), "create \"advised\"");
+  CHECK ((handle = open ("advised")) > 1, "open \"advised\"");
+  for (page = 0; page < PAGE_CNT; page++)
+    {
+      memset (buf, page, sizeof buf);
+      buf[1] = 0;
+      if (write (handle, buf, sizeof buf) != sizeof buf)
+        fail ("write of page %zu failed", page);
+    }
+  CHECK ((map = mmap (handle, ACTUAL)) != MAP_FAILED, "mmap \"advised\"");
+
+  CHECK (madvise (map_base + 1, 4096, MADV_WILLNEED) == -1,
+         "madvise misaligned address");
+  CHECK (madvise (map_base, MAP_SIZE + 4096, MADV_WILLNEED) == -1,
+         "madvise past end of mapping");
+  CHECK (madvise (map_base, MAP_SIZE, 42) == -1, "madvise bad advice");
+
+  CHECK (madvise (map_base, MAP_SIZE, MADV_WILLNEED) == 0,
+         "madvise MADV_WILLNEED");
+  check_mapping (map_base, 0, true);
+
+  for (page = 0; page < PAGE_CNT; page++)
+    map_base[page * 4096 + 1] = 0x5a;
+  CHECK (madvise (map_base, MAP_SIZE, MADV_DONTNEED) == 0,
+         "madvise MADV_DONTNEED");
+  for (page = 0; page < PAGE_CNT; page++)
+    {
+      seek (handle, page * 4096);
+      if (read (handle, buf, sizeof buf) != sizeof buf)
+        fail ("read of page %zu failed", page);
+      for (i = 0; i < sizeof buf; i++)
+        if (buf[i] != (i == 1 ? 0x5a : (char) page))
+          fail ("byte %zu of file is wrong", page * 4096 + i);
+    }
+  msg ("file holds writes dropped by MADV_DONTNEED");
+
+  CHECK (madvise (map_base, MAP_SIZE, MADV_SEQUENTIAL) == 0,
+         "madvise MADV_SEQUENTIAL");
+  check_mapping (map_base, 0x5a, true);
+  check_mapping (map_base, 0x5a, true);
+
+  CHECK (madvise (map_base, MAP_SIZE, MADV_RANDOM) == 0,
+         "madvise MADV_RANDOM");
+  check_mapping (map_base, 0x5a, false);
+
+  munmap (map);
+  close (handle);
+}
@@ -0,0 +1,20 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(mmap-madvise) begin
+(mmap-madvise) create "advised"
+(mmap-madvise) open "advised"
+(mmap-madvise) mmap "advised"
+(mmap-madvise) madvise misaligned address
+(mmap-madvise) madvise past end of mapping
+(mmap-madvise) madvise bad advice
+(mmap-madvise) madvise MADV_WILLNEED
+(mmap-madvise) madvise MADV_DONTNEED
+(mmap-madvise) file holds writes dropped by MADV_DONTNEED
+(mmap-madvise) madvise MADV_SEQUENTIAL
+(mmap-madvise) madvise MADV_RANDOM
+(mmap-madvise) end
+EOF
+pass;
@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-linear-clock2) begin
+(page-linear-clock2) initialize
+(page-linear-clock2) read pass
+(page-linear-clock2) read/modify/write pass one
+(page-linear-clock2) read/modify/write pass two
+(page-linear-clock2) read pass
+(page-linear-clock2) end
+EOF
+pass;
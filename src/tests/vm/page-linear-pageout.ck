@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-linear-pageout) begin
+(page-linear-pageout) initialize
+(page-linear-pageout) read pass
+(page-linear-pageout) read/modify/write pass one
+(page-linear-pageout) read/modify/write pass two
+(page-linear-pageout) read pass
+(page-linear-pageout) end
+EOF
+pass;
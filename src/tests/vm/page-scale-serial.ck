@@ -0,0 +1,10 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-scale-serial) begin
+(page-scale-serial) ran 8 children
+(page-scale-serial) end
+EOF
+pass;
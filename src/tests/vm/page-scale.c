@@ -0,0 +1,40 @@
+/* Runs CHILD_CNT child-scale processes, half of which page
+   through more memory than there is while the other half only
+   touch a few pages.  As page-scale they all run at once; as
+   page-scale-serial one after another.  Compare the run times:
+   with faults of different processes handled in parallel, the
+   small children do not wait behind the large ones' swapping. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define CHILD_CNT 8
+
+static const char *
+child_cmd (int i)
+{
+  return i % 2 == 0 ? "child-scale 512" : "child-scale 16";
+}
+
+void
+test_main (void)
+{
+  bool serial = !strcmp (test_name, "page-scale-serial");
+  pid_t children[CHILD_CNT];
+  int i;
+
+  for (i = 0; i < CHILD_CNT; i++)
+    {
+      if ((children[i] = exec (child_cmd (i))) == PID_ERROR)
+        fail ("exec \"%s\" failed", child_cmd (i));
+      if (serial && wait (children[i]) != 0x42)
+        fail ("child %d failed", i);
+    }
+  if (!serial)
+    for (i = 0; i < CHILD_CNT; i++)
+      if (wait (children[i]) != 0x42)
+        fail ("child %d failed", i);
+  msg ("ran %d children", CHILD_CNT);
+}
@@ -0,0 +1,58 @@
+/* Writes a few words into every page of 2 MB of memory, enough
+   to force most of it out, and verifies them.  Pages like these
+   compress well, so they are mostly kept in memory instead of
+   on the swap disk. */
+
+#include <stdint.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (2 * 1024 * 1024)
+#define PAGE_SIZE 4096
+
+static uint32_t buf[SIZE / sizeof (uint32_t)];
+
+/* Value stored in word WORD of page PAGE. */
+static uint32_t
+sparse_value (size_t page, size_t word)
+{
+  return page * 0x9e3779b9u + word;
+}
+
+static void
+check_pass (void)
+{
+  size_t page;
+
+  for (page = 0; page < SIZE / PAGE_SIZE; page++)
+    {
+      uint32_t *p = buf + page * (PAGE_SIZE / sizeof (uint32_t));
+      size_t word;
+
+      for (word = 0; word < PAGE_SIZE / sizeof (uint32_t); word++)
+        {
+          uint32_t expected = word % 64 == 0 ? sparse_value (page, word) : 0;
+          if (p[word] != expected)
+            fail ("word %zu of page %zu is %#x, not %#x",
+                  word, page, p[word], expected);
+        }
+    }
+}
+
+void
+test_main (void)
+{
+  size_t page, word;
+
+  msg ("write pass");
+  for (page = 0; page < SIZE / PAGE_SIZE; page++)
+    for (word = 0; word < PAGE_SIZE / sizeof (uint32_t); word += 64)
+      buf[page * (PAGE_SIZE / sizeof (uint32_t)) + word]
+        = sparse_value (page, word);
+
+  msg ("read pass");
+  check_pass ();
+
+  msg ("read pass");
+  check_pass ();
+}
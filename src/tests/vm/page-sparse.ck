@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-sparse) begin
+(page-sparse) write pass
+(page-sparse) read pass
+(page-sparse) read pass
+(page-sparse) end
+EOF
+pass;
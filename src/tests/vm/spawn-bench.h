@@ -0,0 +1,12 @@
+#ifndef TESTS_VM_SPAWN_BENCH_H
+#define TESTS_VM_SPAWN_BENCH_H
+
+/* Number of children fork-bench and exec-bench start, one at a
+   time. */
+#define SPAWN_CNT 32
+
+/* Memory the parent touches first, so that it has something to
+   share with its children. */
+#define SPAWN_BUF_SIZE (256 * 1024)
+
+#endif /* tests/vm/spawn-bench.h */
@@ -0,0 +1,66 @@
+#ifndef THREADS_FIXED_POINT_H
+#define THREADS_FIXED_POINT_H
+
+#include <stdint.h>
+
+/* Signed 17.14 fixed-point numbers, as used by the multi-level
+   feedback queue scheduler.  The kernel does not use the FPU,
+   so the scheduler's real-valued quantities are kept as integers
+   scaled by FIX_F.
+
+   Adding or subtracting two fixed-point numbers, or multiplying
+   or dividing one by an integer, is the same as the plain
+   integer operation, so only the other operations need the
+   functions below.  Products and quotients of two fixed-point
+   numbers go through 64 bits so that they do not overflow. */
+typedef int32_t fixed_t;
+
+/* Number of fractional bits. */
+#define FIX_Q 14
+
+/* Fixed-point representation of 1. */
+#define FIX_F (1 << FIX_Q)
+
+/* Returns integer N as a fixed-point number. */
+static inline fixed_t
+fix_int (int n)
+{
+  return n * FIX_F;
+}
+
+/* Returns X rounded toward zero to an integer. */
+static inline int
+fix_trunc (fixed_t x)
+{
+  return x / FIX_F;
+}
+
+/* Returns X rounded to the nearest integer. */
+static inline int
+fix_round (fixed_t x)
+{
+  return x >= 0 ? (x + FIX_F / 2) / FIX_F : (x - FIX_F / 2) / FIX_F;
+}
+
+/* Returns X + N, where N is an integer. */
+static inline fixed_t
+fix_add_int (fixed_t x, int n)
+{
+  return x + n * FIX_F;
+}
+
+/* Returns X * Y. */
+static inline fixed_t
+fix_mul (fixed_t x, fixed_t y)
+{
+  return ((int64_t) x) * y / FIX_F;
+}
+
+/* Returns X / Y. */
+static inline fixed_t
+fix_div (fixed_t x, fixed_t y)
+{
+  return ((int64_t) x) * FIX_F / y;
+}
+
+#endif /* threads/fixed-point.h */
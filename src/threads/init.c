@@ -19,6 +19,7 @@
 #include "threads/malloc.h"
 #include "threads/palloc.h"
 #include "threads/pte.h"
+#include "threads/smp.h"
 #include "threads/thread.h"
 
 #ifdef USERPROG
@@ -33,14 +34,19 @@
 
 #ifdef FILESYS
 #include "devices/disk.h"
+#include "filesys/cache.h"
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
+#include "filesys/inode.h"
 #endif
 
 #ifdef VM
 #include "vm/frame.h"
 #include "vm/page.h"
 #include "vm/swap.h"
+#include "vm/share.h"
+#include "vm/zswap.h"
+#include "vm/pageout.h"
 #endif
 
 /* Amount of physical memory, in 4 kB pages. */
@@ -116,6 +122,7 @@ main (void)
   thread_start ();
   serial_init_queue ();
   timer_calibrate ();
+  smp_init ();
 
 #ifdef FILESYS
   /* Initialize file system. */
@@ -125,7 +132,9 @@ main (void)
 
 #ifdef VM
   frame_table_init();
+  share_init();
   swap_init();
+  pageout_init();
 #endif
 
   printf ("Boot complete.\n");
@@ -260,6 +269,35 @@ parse_options (char **argv)
 #ifdef USERPROG
       else if (!strcmp (name, "-ul"))
         user_page_limit = atoi (value);
+      else if (!strcmp (name, "-serialfs"))
+        serialize_filesys = true;
+#endif
+#ifdef VM
+      else if (!strcmp (name, "-clock2"))
+        clock_enhanced = true;
+      else if (!strcmp (name, "-pageout"))
+        {
+          char *high = value != NULL ? strchr (value, ':') : NULL;
+          if (high == NULL)
+            PANIC ("-pageout requires LOW:HIGH, e.g. -pageout=16:48");
+          pageout_low = atoi (value);
+          pageout_high = atoi (high + 1);
+          if (pageout_high < pageout_low)
+            PANIC ("-pageout: HIGH must be at least LOW");
+        }
+      else if (!strcmp (name, "-swap"))
+        {
+          char *dev = value != NULL ? strchr (value, ':') : NULL;
+          if (dev == NULL)
+            PANIC ("-swap requires CHANNEL:DEVICE, e.g. -swap=1:1");
+          swap_channel = atoi (value);
+          swap_device = atoi (dev + 1);
+          if (swap_channel < 0 || swap_channel > 1
+              || swap_device < 0 || swap_device > 1)
+            PANIC ("-swap: no disk hd%d:%d", swap_channel, swap_device);
+          if (swap_channel == 0 && swap_device == 0)
+            PANIC ("-swap: hd0:0 is the boot disk");
+        }
 #endif
       else
         PANIC ("unknown option `%s' (use -h for help)", name);
@@ -306,6 +344,8 @@ run_actions (char **argv)
       {"rm", 2, fsutil_rm},
       {"put", 2, fsutil_put},
       {"get", 2, fsutil_get},
+      {"dirbench", 2, fsutil_dirbench},
+      {"diskbench", 2, fsutil_diskbench},
 #endif
       {NULL, 0, NULL},
     };
@@ -352,6 +392,8 @@ usage (void)
           "  ls                 List files in the root directory.\n"
           "  cat FILE           Print FILE to the console.\n"
           "  rm FILE            Delete FILE.\n"
+          "  dirbench N         Time creating, opening and deleting N files.\n"
+          "  diskbench N        Time N reads per thread from the scratch disk.\n"
           "Use these actions indirectly via `pintos' -g and -p options:\n"
           "  put FILE           Put FILE into file system from scratch disk.\n"
           "  get FILE           Get FILE from file system into scratch disk.\n"
@@ -364,6 +406,13 @@ usage (void)
           "  -mlfqs             Use multi-level feedback queue scheduler.\n"
 #ifdef USERPROG
           "  -ul=COUNT          Limit user memory to COUNT pages.\n"
+          "  -serialfs          Serialize file system calls on one lock.\n"
+#endif
+#ifdef VM
+          "  -clock2            Use the enhanced clock, which prefers clean pages.\n"
+          "  -pageout=LOW:HIGH  Evict in the background from LOW to HIGH free\n"
+          "                     frames (default 16:48, 0:0 to disable).\n"
+          "  -swap=CHAN:DEV     Swap to disk hdCHAN:DEV (default 1:1).\n"
 #endif
           );
   power_off ();
@@ -404,10 +453,20 @@ print_stats (void)
   thread_print_stats ();
 #ifdef FILESYS
   disk_print_stats ();
+  cache_print_stats ();
+  inode_print_stats ();
 #endif
   console_print_stats ();
   kbd_print_stats ();
 #ifdef USERPROG
   exception_print_stats ();
 #endif
+#ifdef VM
+  frame_print_stats ();
+  swap_print_stats ();
+  zswap_print_stats ();
+  pageout_print_stats ();
+  share_print_stats ();
+  page_print_stats ();
+#endif
 }
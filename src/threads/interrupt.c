@@ -6,6 +6,8 @@
 #include "threads/flags.h"
 #include "threads/intr-stubs.h"
 #include "threads/io.h"
+#include "threads/smp.h"
+#include "threads/spinlock.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
 #include "devices/timer.h"
@@ -25,15 +27,39 @@ static intr_handler_func *intr_handlers[INTR_CNT];
 /* Names for each interrupt, for debugging purposes. */
 static const char *intr_names[INTR_CNT];
 
+/* Interrupts delivered by the local APIC, which need an EOI
+   there, and those of them handled without the kernel lock. */
+static bool intr_lapic[INTR_CNT];
+static bool intr_unlocked[INTR_CNT];
+
 /* External interrupts are those generated by devices outside the
-   CPU, such as the timer.  External interrupts run with
-   interrupts turned off, so they never nest, nor are they ever
-   pre-empted.  Handlers for external interrupts also may not
-   sleep, although they may invoke intr_yield_on_return() to
-   request that a new process be scheduled just before the
-   interrupt returns. */
-static bool in_external_intr;   /* Are we processing an external interrupt? */
-static bool yield_on_return;    /* Should we yield on interrupt return? */
+   CPU, such as the timer, and by the local APIC.  External
+   interrupts run with interrupts turned off, so they never nest,
+   nor are they ever pre-empted.  Handlers for external
+   interrupts also may not sleep, although they may invoke
+   intr_yield_on_return() to request that a new process be
+   scheduled just before the interrupt returns.  Whether a
+   processor is processing an external interrupt, and whether it
+   should yield on return, are kept in its struct cpu. */
+
+/* The kernel lock.
+
+   Kernel code makes itself atomic by turning interrupts off,
+   which used to be enough because there was one processor.  With
+   several, turning interrupts off also acquires this lock and
+   turning them back on releases it, so on each processor
+   interrupts are off exactly when that processor holds the lock.
+   Thus code that runs with interrupts off, including the
+   scheduler and the semaphores and locks of synch.c, still runs
+   on one processor at a time, while threads that have
+   interrupts on run in parallel.
+
+   A thread switch happens with interrupts off, so the lock is
+   handed from the thread that switches out to the one that
+   switches in, which releases it when it turns interrupts back
+   on.  The lock starts out held because the bootstrap processor
+   boots with interrupts off. */
+static struct spinlock intr_lock = { 1 };
 
 /* Programmable Interrupt Controller helpers. */
 static void pic_init (void);
@@ -46,6 +72,8 @@ static inline uint64_t make_idtr_operand (uint16_t limit, void *base);
 
 /* Interrupt handlers. */
 void intr_handler (struct intr_frame *args);
+
+static void intr_lock_acquire (void);
 
 /* Returns the current interrupt status. */
 enum intr_level
@@ -77,10 +105,13 @@ intr_enable (void)
   enum intr_level old_level = intr_get_level ();
   ASSERT (!intr_context ());
 
-  /* Enable interrupts by setting the interrupt flag.
+  /* Enable interrupts by setting the interrupt flag, after
+     releasing the kernel lock.
 
      See [IA32-v2b] "STI" and [IA32-v3a] 5.8.1 "Masking Maskable
      Hardware Interrupts". */
+  if (old_level == INTR_OFF)
+    spin_release (&intr_lock);
   asm volatile ("sti");
 
   return old_level;
@@ -92,13 +123,46 @@ intr_disable (void)
 {
   enum intr_level old_level = intr_get_level ();
 
-  /* Disable interrupts by clearing the interrupt flag.
+  /* Disable interrupts by clearing the interrupt flag, then
+     acquire the kernel lock.
      See [IA32-v2b] "CLI" and [IA32-v3a] 5.8.1 "Masking Maskable
      Hardware Interrupts". */
   asm volatile ("cli" : : : "memory");
+  if (old_level == INTR_ON)
+    intr_lock_acquire ();
 
   return old_level;
 }
+
+/* Enables interrupts and waits for the next one, as the idle
+   thread does when no thread is ready.  Interrupts must be off.
+
+   The `sti' instruction disables interrupts until the
+   completion of the next instruction, so `sti' and `hlt' are
+   executed atomically.  This atomicity is important; otherwise,
+   an interrupt could be handled between re-enabling interrupts
+   and waiting for the next one to occur, wasting as much as one
+   clock tick worth of time.
+
+   See [IA32-v2a] "HLT", [IA32-v2b] "STI", and [IA32-v3a]
+   7.11.1 "HLT Instruction". */
+void
+intr_wait (void)
+{
+  ASSERT (!intr_context ());
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  spin_release (&intr_lock);
+  asm volatile ("sti; hlt" : : : "memory");
+}
+
+/* Acquires the kernel lock, with interrupts off. */
+static void
+intr_lock_acquire (void)
+{
+  while (!spin_try_acquire (&intr_lock))
+    smp_spin_wait ();
+}
 
 /* Initializes the interrupt system. */
 void
@@ -144,6 +208,21 @@ intr_init (void)
   intr_names[19] = "#XF SIMD Floating-Point Exception";
 }
 
+/* Prepares an application processor, which starts with
+   interrupts off, for interrupts: it acquires the kernel lock
+   and loads the IDT that intr_init() set up. */
+void
+intr_init_ap (void)
+{
+  uint64_t idtr_operand;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  intr_lock_acquire ();
+  idtr_operand = make_idtr_operand (sizeof idt - 1, idt);
+  asm volatile ("lidt %0" : : "m" (idtr_operand));
+}
+
 /* Registers interrupt VEC_NO to invoke HANDLER with descriptor
    privilege level DPL.  Names the interrupt NAME for debugging
    purposes.  The interrupt handler will be invoked with
@@ -172,6 +251,24 @@ intr_register_ext (uint8_t vec_no, intr_handler_func *handler,
   register_handler (vec_no, 0, INTR_OFF, handler, name);
 }
 
+/* Registers local APIC interrupt VEC_NO to invoke HANDLER, which
+   is named NAME for debugging purposes.  The handler will
+   execute as that of an external interrupt does.  If LOCKED is
+   false, it will instead execute without the kernel lock and
+   outside interrupt context, and so it may touch only the
+   running processor's own state; the TLB shootdown IPI must be
+   handled this way, because the processor that sends it may
+   hold the kernel lock while it waits. */
+void
+intr_register_lapic (uint8_t vec_no, bool locked,
+                     intr_handler_func *handler, const char *name)
+{
+  ASSERT (vec_no > 0x2f);
+  register_handler (vec_no, 0, INTR_OFF, handler, name);
+  intr_lapic[vec_no] = true;
+  intr_unlocked[vec_no] = !locked;
+}
+
 /* Registers internal interrupt VEC_NO to invoke HANDLER, which
    is named NAME for debugging purposes.  The interrupt handler
    will be invoked with interrupt status LEVEL.
@@ -198,7 +295,7 @@ intr_register_int (uint8_t vec_no, int dpl, enum intr_level level,
 bool
 intr_context (void) 
 {
-  return in_external_intr;
+  return cpu_current ()->in_external_intr;
 }
 
 /* During processing of an external interrupt, directs the
@@ -209,7 +306,7 @@ void
 intr_yield_on_return (void) 
 {
   ASSERT (intr_context ());
-  yield_on_return = true;
+  cpu_current ()->yield_on_return = true;
 }
 
 /* 8259A Programmable Interrupt Controller. */
@@ -338,21 +435,36 @@ make_idtr_operand (uint16_t limit, void *base)
 void
 intr_handler (struct intr_frame *frame) 
 {
-  bool external;
+  bool pic, external;
+  bool was_on = (frame->eflags & FLAG_IF) != 0;
   intr_handler_func *handler;
 
+  if (intr_unlocked[frame->vec_no])
+    {
+      intr_handlers[frame->vec_no] (frame);
+      lapic_eoi ();
+      return;
+    }
+
+  /* If the interrupt turned interrupts off, take the kernel lock
+     that the interrupted code did not hold. */
+  if (was_on && intr_get_level () == INTR_OFF)
+    intr_lock_acquire ();
+
   /* External interrupts are special.
      We only handle one at a time (so interrupts must be off)
-     and they need to be acknowledged on the PIC (see below).
+     and they need to be acknowledged on the PIC or the local
+     APIC (see below).
      An external interrupt handler cannot sleep. */
-  external = frame->vec_no >= 0x20 && frame->vec_no < 0x30;
+  pic = frame->vec_no >= 0x20 && frame->vec_no < 0x30;
+  external = pic || intr_lapic[frame->vec_no];
   if (external) 
     {
       ASSERT (intr_get_level () == INTR_OFF);
       ASSERT (!intr_context ());
 
-      in_external_intr = true;
-      yield_on_return = false;
+      cpu_current ()->in_external_intr = true;
+      cpu_current ()->yield_on_return = false;
     }
 
   /* Invoke the interrupt's handler. */
@@ -379,12 +491,23 @@ intr_handler (struct intr_frame *frame)
       ASSERT (intr_get_level () == INTR_OFF);
       ASSERT (intr_context ());
 
-      in_external_intr = false;
-      pic_end_of_interrupt (frame->vec_no); 
+      cpu_current ()->in_external_intr = false;
+      if (pic)
+        pic_end_of_interrupt (frame->vec_no);
+      else
+        lapic_eoi ();
 
-      if (yield_on_return) 
+      if (cpu_current ()->yield_on_return) 
         thread_yield (); 
     }
+
+  /* Leave the kernel lock as the interrupted code had it.  A
+     handler may have turned interrupts on, as the page fault
+     handler does. */
+  if (was_on && intr_get_level () == INTR_OFF)
+    spin_release (&intr_lock);
+  else if (!was_on && intr_get_level () == INTR_ON)
+    intr_disable ();
 }
 
 /* Dumps interrupt frame F to the console, for debugging. */
@@ -5,6 +5,11 @@
 #define LOADER_BASE 0x7c00      /* Physical address of loader's base. */
 #define LOADER_END  0x7e00      /* Physical address of end of loader. */
 
+/* Physical address at which application processors start up.
+   Must be a page boundary below 1 MB that neither the loader
+   nor the kernel occupies.  See ap-start.S. */
+#define LOADER_AP_BASE 0x6000
+
 /* Physical address of kernel base. */
 #define LOADER_KERN_BASE 0x100000       /* 1 MB. */
 
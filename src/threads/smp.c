@@ -0,0 +1,550 @@
+#include "threads/smp.h"
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/flags.h"
+#include "threads/init.h"
+#include "threads/interrupt.h"
+#include "threads/loader.h"
+#include "threads/palloc.h"
+#include "threads/pte.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+#include "devices/timer.h"
+#ifdef USERPROG
+#include "userprog/gdt.h"
+#endif
+
+/* Multiprocessor support.
+
+   The BIOS describes the processors in the machine in the tables
+   of the MultiProcessor Specification [MPSPEC].  smp_init() finds
+   them there and starts each application processor through its
+   local APIC, the per-processor interrupt controller that also
+   sends and receives interprocessor interrupts (IPIs) and has a
+   timer of its own [IA32-v3a] chapter 8 "Advanced Programmable
+   Interrupt Controller (APIC)".
+
+   All processors share the kernel, the IDT, and the kernel lock
+   described in interrupt.c.  Each has its own scheduler state in
+   struct cpu, its own idle thread, and, under USERPROG, its own
+   TSS.  Device interrupts, including the 8254 timer that drives
+   timer_ticks(), go to the bootstrap processor only; application
+   processors take timer ticks from their local APIC timers. */
+
+/* Processors.  Application processors are counted in cpu_cnt
+   once they have started. */
+struct cpu cpus[CPU_MAX];
+unsigned cpu_cnt = 1;
+
+/* MP floating pointer structure.  See [MPSPEC] 4.1. */
+struct mp_fp
+  {
+    char signature[4];          /* "_MP_". */
+    uint32_t config;            /* Physical address of mp_config. */
+    uint8_t length;             /* In 16-byte units. */
+    uint8_t revision;
+    uint8_t checksum;           /* All bytes must add to 0. */
+    uint8_t features[5];        /* Nonzero features[0]: no table. */
+  } __attribute__ ((packed));
+
+/* MP configuration table header.  See [MPSPEC] 4.2.  Entries
+   follow it. */
+struct mp_config
+  {
+    char signature[4];          /* "PCMP". */
+    uint16_t length;            /* Length of header plus entries. */
+    uint8_t revision;
+    uint8_t checksum;           /* All bytes must add to 0. */
+    char oem_id[8];
+    char product_id[12];
+    uint32_t oem_table;
+    uint16_t oem_length;
+    uint16_t entry_cnt;         /* Number of entries. */
+    uint32_t lapic;             /* Physical address of local APICs. */
+    uint16_t ext_length;
+    uint8_t ext_checksum;
+    uint8_t reserved;
+  } __attribute__ ((packed));
+
+/* MP configuration table processor entry.  See [MPSPEC] 4.3.1.
+   All other entry types are 8 bytes long. */
+struct mp_proc
+  {
+    uint8_t type;               /* MP_PROC. */
+    uint8_t apic_id;            /* Local APIC ID. */
+    uint8_t apic_version;
+    uint8_t flags;              /* MP_PROC_*. */
+    uint32_t signature;
+    uint32_t features;
+    uint32_t reserved[2];
+  } __attribute__ ((packed));
+
+#define MP_PROC 0               /* Processor entry type. */
+#define MP_PROC_EN 0x01         /* Processor is usable. */
+#define MP_PROC_BP 0x02         /* Processor is the bootstrap processor. */
+
+/* Local APIC registers, as byte offsets. */
+#define LAPIC_ID 0x020          /* ID. */
+#define LAPIC_TPR 0x080         /* Task priority. */
+#define LAPIC_EOI 0x0b0         /* End of interrupt. */
+#define LAPIC_SVR 0x0f0         /* Spurious interrupt vector. */
+#define LAPIC_ESR 0x280         /* Error status. */
+#define LAPIC_ICR_LO 0x300      /* Interrupt command, bits 0-31. */
+#define LAPIC_ICR_HI 0x310      /* Interrupt command, bits 32-63. */
+#define LAPIC_TIMER 0x320       /* LVT timer. */
+#define LAPIC_LINT0 0x350       /* LVT LINT0. */
+#define LAPIC_LINT1 0x360       /* LVT LINT1. */
+#define LAPIC_ERROR 0x370       /* LVT error. */
+#define LAPIC_TIMER_INIT 0x380  /* Timer initial count. */
+#define LAPIC_TIMER_CUR 0x390   /* Timer current count. */
+#define LAPIC_TIMER_DIV 0x3e0   /* Timer divide configuration. */
+
+/* Register bits. */
+#define SVR_ENABLE 0x100        /* Enable the local APIC. */
+#define LVT_EXTINT 0x700        /* Deliver as from the 8259A PIC. */
+#define LVT_NMI 0x400           /* Deliver as NMI. */
+#define LVT_MASKED 0x10000      /* Interrupt masked. */
+#define LVT_PERIODIC 0x20000    /* Timer repeats. */
+#define TIMER_DIV_16 0x3        /* Timer counts at bus clock / 16. */
+#define ICR_INIT 0x500          /* INIT IPI. */
+#define ICR_STARTUP 0x600       /* Startup IPI. */
+#define ICR_PENDING 0x1000      /* Previous IPI not yet sent. */
+#define ICR_ASSERT 0x4000       /* Level assert. */
+#define ICR_LEVEL 0x8000        /* Level triggered. */
+
+/* Number of timer ticks to measure the local APIC timer over. */
+#define CALIBRATE_TICKS 5
+
+/* Local APIC registers, mapped at their physical address. */
+static volatile uint32_t *lapic;
+
+/* Local APIC timer count for one timer tick. */
+static uint32_t lapic_timer_count;
+
+/* Startup code in ap-start.S, and its variables. */
+extern uint8_t ap_start[], ap_end[];
+extern uint32_t ap_cr3, ap_stack;
+
+static struct mp_config *mp_find (void);
+static struct mp_proc *mp_next_ap (struct mp_config *, uint8_t **entry);
+static struct mp_fp *mp_search (uintptr_t paddr, size_t size);
+static uint8_t checksum (const void *, size_t);
+static bool ap_boot (struct cpu *);
+static uint32_t *ap_var (uint32_t *);
+static void lapic_map (uintptr_t paddr);
+static void lapic_init (bool bsp);
+static void lapic_timer_calibrate (void);
+static void lapic_ipi (uint8_t apic_id, uint32_t icr);
+static void tlb_flush_pending (struct cpu *);
+static intr_handler_func lapic_timer_interrupt;
+static intr_handler_func resched_interrupt;
+static intr_handler_func tlb_interrupt;
+static intr_handler_func spurious_interrupt;
+
+/* Starts the application processors, if the BIOS reports any.
+   Must be called with interrupts on, once timer_calibrate() has
+   run, because starting a processor takes a few timed delays. */
+void
+smp_init (void)
+{
+  struct mp_config *mpc = mp_find ();
+  struct mp_proc *proc;
+  enum intr_level old_level;
+  uint8_t *entry = NULL;
+
+  ASSERT (intr_get_level () == INTR_ON);
+
+  /* Leave a uniprocessor alone. */
+  if (mpc == NULL || mp_next_ap (mpc, &entry) == NULL)
+    return;
+
+  intr_register_lapic (SMP_TIMER_VEC, true, lapic_timer_interrupt,
+                       "LAPIC Timer");
+  intr_register_lapic (SMP_RESCHED_VEC, true, resched_interrupt,
+                       "Reschedule IPI");
+  intr_register_lapic (SMP_TLB_VEC, false, tlb_interrupt,
+                       "TLB Shootdown IPI");
+  intr_register_int (SMP_SPURIOUS_VEC, 0, INTR_OFF, spurious_interrupt,
+                     "LAPIC Spurious");
+
+  old_level = intr_disable ();
+  lapic_map (mpc->lapic);
+  lapic_init (true);
+  cpus[0].apic_id = lapic[LAPIC_ID / 4] >> 24;
+  intr_set_level (old_level);
+  lapic_timer_calibrate ();
+
+  /* Copy the startup code into low memory and map the bottom
+     4 MB of physical memory at virtual address 0, as the loader
+     does, for the few instructions it runs after turning on
+     paging.  No user page directory exists yet to inherit the
+     mapping. */
+  memcpy (ptov (LOADER_AP_BASE), ap_start, ap_end - ap_start);
+  base_page_dir[0] = base_page_dir[pd_no (PHYS_BASE)];
+
+  entry = NULL;
+  while (cpu_cnt < CPU_MAX && (proc = mp_next_ap (mpc, &entry)) != NULL)
+    {
+      if (proc->apic_id == cpus[0].apic_id)
+        continue;
+
+      cpus[cpu_cnt].id = cpu_cnt;
+      cpus[cpu_cnt].apic_id = proc->apic_id;
+      if (!ap_boot (&cpus[cpu_cnt]))
+        {
+          printf ("smp: processor with APIC ID %d did not start\n",
+                  proc->apic_id);
+          break;
+        }
+      old_level = intr_disable ();
+      cpu_cnt++;
+      intr_set_level (old_level);
+    }
+
+  base_page_dir[0] = 0;
+  asm volatile ("movl %0, %%cr3" : : "r" (vtop (base_page_dir)) : "memory");
+
+  printf ("smp: %u processors running\n", cpu_cnt);
+}
+
+/* Asks processor CPU to reschedule, because a thread that should
+   preempt the one it runs has become ready.  Interrupts must be
+   off. */
+void
+smp_resched (struct cpu *cpu)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (cpu != cpu_current ());
+
+  lapic_ipi (cpu->apic_id, SMP_RESCHED_VEC);
+}
+
+/* Makes sure that no other processor keeps stale entries from
+   page directory PD in its TLB: every processor that has PD
+   active is interrupted to flush its TLB, and this function
+   waits until they all have.  The caller must already have
+   changed the page table entries and flushed its own TLB. */
+void
+smp_tlb_shootdown (uint32_t *pd)
+{
+  struct cpu *self = cpu_current ();
+  unsigned req[CPU_MAX];
+  uint32_t sent = 0;
+  unsigned i;
+
+  /* Order the page table changes before the loads of
+     cpus[i].pagedir below.  pagedir_activate() does the same
+     between storing cpu->pagedir and loading CR3, so either we
+     see a processor using PD, or it loads CR3 after our
+     changes. */
+  __sync_synchronize ();
+
+  for (i = 0; i < cpu_cnt; i++)
+    if (&cpus[i] != self && cpus[i].pagedir == pd)
+      {
+        req[i] = __sync_add_and_fetch (&cpus[i].tlb_req, 1);
+        sent |= 1u << i;
+        lapic_ipi (cpus[i].apic_id, SMP_TLB_VEC);
+      }
+
+  for (i = 0; i < cpu_cnt; i++)
+    if (sent & (1u << i))
+      while ((int) (cpus[i].tlb_done - req[i]) < 0)
+        smp_spin_wait ();
+}
+
+/* Waits a little, for use in busy-waiting loops.  Carries out a
+   TLB flush requested of this processor meanwhile, since the
+   processor it is waiting for might be waiting for that. */
+void
+smp_spin_wait (void)
+{
+  tlb_flush_pending (cpu_current ());
+  asm volatile ("pause" : : : "memory");
+}
+
+/* Acknowledges the interrupt the local APIC is delivering. */
+void
+lapic_eoi (void)
+{
+  lapic[LAPIC_EOI / 4] = 0;
+}
+
+/* Entry point of an application processor, called by
+   ap-start.S on the stack of the idle thread that ap_boot()
+   prepared for it, with interrupts off. */
+void
+ap_main (void)
+{
+  struct cpu *cpu = cpu_current ();
+
+  intr_init_ap ();
+#ifdef USERPROG
+  gdt_init_ap ();
+#endif
+  cpu->pagedir = base_page_dir;
+  lapic_init (false);
+  lapic[LAPIC_TIMER_DIV / 4] = TIMER_DIV_16;
+  lapic[LAPIC_TIMER / 4] = LVT_PERIODIC | SMP_TIMER_VEC;
+  lapic[LAPIC_TIMER_INIT / 4] = lapic_timer_count;
+
+  thread_start_ap ();
+}
+
+/* Starts application processor CPU and waits for it to reach
+   the scheduler.  Returns true if successful, false on failure.
+   See [IA32-v3a] 8.4.4 "MP Initialization Example". */
+static bool
+ap_boot (struct cpu *cpu)
+{
+  struct thread *idle = thread_create_idle (cpu);
+  int64_t start;
+  int i;
+
+  if (idle == NULL)
+    return false;
+  *ap_var (&ap_cr3) = vtop (base_page_dir);
+  *ap_var (&ap_stack) = (uint32_t) idle + PGSIZE;
+
+  lapic_ipi (cpu->apic_id, ICR_INIT | ICR_LEVEL | ICR_ASSERT);
+  lapic_ipi (cpu->apic_id, ICR_INIT | ICR_LEVEL);
+  timer_msleep (10);
+  for (i = 0; i < 2; i++)
+    {
+      lapic_ipi (cpu->apic_id, ICR_STARTUP | (LOADER_AP_BASE >> PGBITS));
+      timer_usleep (200);
+    }
+
+  start = timer_ticks ();
+  while (!cpu->started && timer_elapsed (start) < TIMER_FREQ)
+    barrier ();
+  return cpu->started;
+}
+
+/* Returns the address of startup code variable VAR in the copy
+   of the startup code at LOADER_AP_BASE. */
+static uint32_t *
+ap_var (uint32_t *var)
+{
+  return ptov (LOADER_AP_BASE + ((uint8_t *) var - ap_start));
+}
+
+/* Finds the MP configuration table and returns it, or a null
+   pointer if there is none or it is not in mapped memory. */
+static struct mp_config *
+mp_find (void)
+{
+  uint16_t ebda = *(uint16_t *) ptov (0x40e);
+  uint16_t base_kb = *(uint16_t *) ptov (0x413);
+  struct mp_fp *fp;
+  struct mp_config *mpc;
+
+  /* See [MPSPEC] 4 "MP Configuration Table". */
+  fp = ebda != 0 ? mp_search (ebda << 4, 1024) : NULL;
+  if (fp == NULL)
+    fp = mp_search (base_kb * 1024 - 1024, 1024);
+  if (fp == NULL)
+    fp = mp_search (0xf0000, 0x10000);
+  if (fp == NULL || fp->config == 0 || fp->features[0] != 0
+      || fp->config >= ram_pages * PGSIZE - sizeof *mpc)
+    return NULL;
+
+  mpc = ptov (fp->config);
+  if (memcmp (mpc->signature, "PCMP", 4)
+      || fp->config + mpc->length > ram_pages * PGSIZE
+      || checksum (mpc, mpc->length) != 0)
+    return NULL;
+  return mpc;
+}
+
+/* Returns the MP configuration table MPC's next entry for a
+   usable application processor after *ENTRY, which is a null
+   pointer to start from the first entry, and advances *ENTRY
+   past it.  Returns a null pointer after the last one. */
+static struct mp_proc *
+mp_next_ap (struct mp_config *mpc, uint8_t **entry)
+{
+  uint8_t *end = (uint8_t *) mpc + mpc->length;
+
+  if (*entry == NULL)
+    *entry = (uint8_t *) (mpc + 1);
+  while (*entry < end)
+    {
+      struct mp_proc *proc = (struct mp_proc *) *entry;
+
+      if (proc->type != MP_PROC)
+        {
+          *entry += 8;
+          continue;
+        }
+      *entry += sizeof *proc;
+      if ((proc->flags & MP_PROC_EN) && !(proc->flags & MP_PROC_BP))
+        return proc;
+    }
+  return NULL;
+}
+
+/* Searches the SIZE bytes of physical memory at PADDR for the
+   MP floating pointer structure and returns it, or a null
+   pointer if it is not there. */
+static struct mp_fp *
+mp_search (uintptr_t paddr, size_t size)
+{
+  uint8_t *p, *end;
+
+  if (paddr + size > ram_pages * PGSIZE)
+    return NULL;
+  for (p = ptov (paddr), end = p + size; p < end; p += 16)
+    if (!memcmp (p, "_MP_", 4) && checksum (p, sizeof (struct mp_fp)) == 0)
+      return (struct mp_fp *) p;
+  return NULL;
+}
+
+/* Returns the sum of the SIZE bytes at P, modulo 256. */
+static uint8_t
+checksum (const void *p_, size_t size)
+{
+  const uint8_t *p = p_;
+  uint8_t sum = 0;
+
+  while (size-- > 0)
+    sum += *p++;
+  return sum;
+}
+
+/* Maps the local APIC registers at physical address PADDR at the
+   same virtual address in base_page_dir, uncached, since they
+   are device registers.  Page directories created later inherit
+   the mapping. */
+static void
+lapic_map (uintptr_t paddr)
+{
+  void *vaddr = (void *) paddr;
+  uint32_t *pde = base_page_dir + pd_no (vaddr);
+  uint32_t *pt;
+
+  ASSERT (pg_ofs (vaddr) == 0);
+  ASSERT (vaddr >= ptov (ram_pages * PGSIZE));
+
+  if (*pde == 0)
+    *pde = pde_create (palloc_get_page (PAL_ASSERT | PAL_ZERO));
+  pt = pde_get_pt (*pde);
+  pt[pt_no (vaddr)] = paddr | PTE_PCD | PTE_PWT | PTE_W | PTE_P;
+  asm volatile ("movl %0, %%cr3" : : "r" (vtop (base_page_dir)) : "memory");
+
+  lapic = vaddr;
+}
+
+/* Enables the running processor's local APIC.  The bootstrap
+   processor, as BSP indicates, keeps taking 8259A PIC interrupts
+   through LINT0 and NMIs through LINT1, as the BIOS left them;
+   application processors take neither. */
+static void
+lapic_init (bool bsp)
+{
+  lapic[LAPIC_SVR / 4] = SVR_ENABLE | SMP_SPURIOUS_VEC;
+  lapic[LAPIC_LINT0 / 4] = bsp ? LVT_EXTINT : LVT_MASKED;
+  lapic[LAPIC_LINT1 / 4] = bsp ? LVT_NMI : LVT_MASKED;
+  lapic[LAPIC_ERROR / 4] = LVT_MASKED;
+  lapic[LAPIC_TIMER / 4] = LVT_MASKED;
+  lapic[LAPIC_ESR / 4] = 0;
+  lapic[LAPIC_ESR / 4] = 0;
+  lapic[LAPIC_EOI / 4] = 0;
+  lapic[LAPIC_TPR / 4] = 0;
+}
+
+/* Measures how far the local APIC timer counts in one timer
+   tick, in lapic_timer_count.  All processors' local APIC
+   timers run at the same rate. */
+static void
+lapic_timer_calibrate (void)
+{
+  int64_t start;
+
+  ASSERT (intr_get_level () == INTR_ON);
+
+  lapic[LAPIC_TIMER_DIV / 4] = TIMER_DIV_16;
+  lapic[LAPIC_TIMER / 4] = LVT_MASKED | SMP_TIMER_VEC;
+
+  /* Wait for a timer tick to start at, then count down over
+     CALIBRATE_TICKS ticks. */
+  start = timer_ticks ();
+  while (timer_ticks () == start)
+    barrier ();
+  lapic[LAPIC_TIMER_INIT / 4] = UINT32_MAX;
+  start = timer_ticks ();
+  while (timer_elapsed (start) < CALIBRATE_TICKS)
+    barrier ();
+  lapic_timer_count = (UINT32_MAX - lapic[LAPIC_TIMER_CUR / 4])
+                      / CALIBRATE_TICKS;
+  lapic[LAPIC_TIMER_INIT / 4] = 0;
+}
+
+/* Sends the interprocessor interrupt described by ICR, the low
+   word of the interrupt command register, to the processor with
+   APIC_ID.  The interrupt command register is the running
+   processor's, so the processor must not change in between, but
+   the caller need not hold the kernel lock, so interrupts are
+   turned off directly instead of by intr_disable(). */
+static void
+lapic_ipi (uint8_t apic_id, uint32_t icr)
+{
+  uint32_t flags;
+
+  asm volatile ("pushfl; popl %0; cli" : "=g" (flags) : : "memory");
+  lapic[LAPIC_ICR_HI / 4] = (uint32_t) apic_id << 24;
+  lapic[LAPIC_ICR_LO / 4] = icr;
+  while (lapic[LAPIC_ICR_LO / 4] & ICR_PENDING)
+    asm volatile ("pause");
+  if (flags & FLAG_IF)
+    asm volatile ("sti" : : : "memory");
+}
+
+/* Flushes CPU's TLB, which must be the running processor's, if
+   another processor has asked it to since it last did.  The
+   request count is read before flushing, so a request counts as
+   done only by a flush that began after it was made. */
+static void
+tlb_flush_pending (struct cpu *cpu)
+{
+  unsigned req = cpu->tlb_req;
+
+  if (req != cpu->tlb_done)
+    {
+      uint32_t cr3;
+
+      asm volatile ("movl %%cr3, %0; movl %0, %%cr3"
+                    : "=r" (cr3) : : "memory");
+      cpu->tlb_done = req;
+    }
+}
+
+/* Local APIC timer interrupt handler, for application
+   processors. */
+static void
+lapic_timer_interrupt (struct intr_frame *args UNUSED)
+{
+  thread_tick ();
+}
+
+/* Reschedule IPI handler. */
+static void
+resched_interrupt (struct intr_frame *args UNUSED)
+{
+  thread_preempt ();
+}
+
+/* TLB shootdown IPI handler.  Runs without the kernel lock. */
+static void
+tlb_interrupt (struct intr_frame *args UNUSED)
+{
+  tlb_flush_pending (cpu_current ());
+}
+
+/* Spurious local APIC interrupt handler.  The local APIC does
+   not expect an EOI for these, so there is nothing to do. */
+static void
+spurious_interrupt (struct intr_frame *args UNUSED)
+{
+}
@@ -0,0 +1,65 @@
+#ifndef THREADS_SMP_H
+#define THREADS_SMP_H
+
+#include <debug.h>
+#include <list.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "threads/thread.h"
+
+/* Maximum number of processors. */
+#define CPU_MAX 8
+
+/* Local APIC interrupt vectors. */
+#define SMP_TIMER_VEC 0x40      /* Local APIC timer. */
+#define SMP_RESCHED_VEC 0x41    /* Reschedule IPI. */
+#define SMP_TLB_VEC 0x42        /* TLB shootdown IPI. */
+#define SMP_SPURIOUS_VEC 0xff   /* Spurious interrupt. */
+
+/* A processor.
+
+   The bootstrap processor, the one the BIOS runs the loader on,
+   is always cpus[0].  smp_init() starts the others, the
+   application processors, as cpus[1] through cpus[cpu_cnt - 1].
+   Everything here is protected by the kernel lock, that is, by
+   turning interrupts off, except the members used for TLB
+   shootdown, which other processors access while this one may
+   be spinning for the lock. */
+struct cpu
+  {
+    /* Owned by smp.c. */
+    unsigned id;                        /* Index in cpus[]. */
+    uint8_t apic_id;                    /* Local APIC ID. */
+    volatile bool started;              /* Booted and scheduling? */
+
+    /* Owned by thread.c. */
+    struct list ready_queues[PRI_MAX + 1]; /* Run queues. */
+    uint64_t ready_mask;                /* Nonempty run queues. */
+    int ready_cnt;                      /* # of threads in READY_QUEUES. */
+    struct thread *curr;                /* Running thread. */
+    struct thread *idle_thread;         /* Runs when no thread is ready. */
+    unsigned thread_ticks;              /* # of timer ticks since last yield. */
+
+    /* Owned by interrupt.c. */
+    bool in_external_intr;              /* Processing an external interrupt? */
+    bool yield_on_return;               /* Yield on interrupt return? */
+
+    /* Shared between smp.c and userprog/pagedir.c. */
+    uint32_t *volatile pagedir;         /* Active page directory. */
+    volatile unsigned tlb_req;          /* # of TLB flushes requested. */
+    volatile unsigned tlb_done;         /* Last request flushed for. */
+  };
+
+extern struct cpu cpus[CPU_MAX];
+extern unsigned cpu_cnt;
+
+struct cpu *cpu_current (void);
+
+void smp_init (void);
+void smp_resched (struct cpu *);
+void smp_tlb_shootdown (uint32_t *pd);
+void smp_spin_wait (void);
+void lapic_eoi (void);
+void ap_main (void) NO_RETURN;
+
+#endif /* threads/smp.h */
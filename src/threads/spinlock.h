@@ -0,0 +1,41 @@
+#ifndef THREADS_SPINLOCK_H
+#define THREADS_SPINLOCK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* A spinlock: a processor that wants it while another processor
+   holds it busy-waits instead of sleeping, so it may be used
+   with interrupts off.  It has no owner, so it can be acquired
+   by one thread and released by another running on the same
+   processor, as happens to the kernel lock across a thread
+   switch (see interrupt.c). */
+struct spinlock
+  {
+    volatile uint32_t locked;   /* 1 if held, 0 if free. */
+  };
+
+/* Tries to acquire S and returns true if successful, false if
+   it is held.  An xchg with a memory operand is locked, so only
+   one processor can see the old value 0.  See [IA32-v2b]
+   "XCHG". */
+static inline bool
+spin_try_acquire (struct spinlock *s)
+{
+  uint32_t old = 1;
+
+  asm volatile ("xchgl %0, %1" : "+r" (old), "+m" (s->locked) : : "memory");
+  return old == 0;
+}
+
+/* Releases S.  x86 processors do not reorder a store with
+   earlier loads or stores, so a plain store releases the lock
+   once the compiler is kept from moving accesses past it. */
+static inline void
+spin_release (struct spinlock *s)
+{
+  asm volatile ("" : : : "memory");
+  s->locked = 0;
+}
+
+#endif /* threads/spinlock.h */
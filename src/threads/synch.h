@@ -22,6 +22,7 @@ struct lock
   {
     struct thread *holder;      /* Thread holding lock (for debugging). */
     struct semaphore semaphore; /* Binary semaphore controlling access. */
+    struct list_elem elem;      /* Element in holder's `held_locks'. */
   };
 
 void lock_init (struct lock *);
@@ -41,6 +42,22 @@ void cond_wait (struct condition *, struct lock *);
 void cond_signal (struct condition *, struct lock *);
 void cond_broadcast (struct condition *, struct lock *);
 
+/* Readers-writer lock.  Any number of readers, or a single
+   writer, may hold it at once. */
+struct rwlock
+  {
+    struct lock lock;           /* Protects the fields below. */
+    struct condition changed;   /* Signaled when the lock is released. */
+    int reader_cnt;             /* Number of readers holding the lock. */
+    struct thread *writer;      /* Writer holding the lock, if any. */
+  };
+
+void rw_init (struct rwlock *);
+void rw_acquire_read (struct rwlock *);
+void rw_release_read (struct rwlock *);
+void rw_acquire_write (struct rwlock *);
+void rw_release_write (struct rwlock *);
+
 /* Optimization barrier.
 
    The compiler will not reorder operations across an
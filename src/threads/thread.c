@@ -8,9 +8,11 @@
 #include "threads/interrupt.h"
 #include "threads/intr-stubs.h"
 #include "threads/palloc.h"
+#include "threads/smp.h"
 #include "threads/switch.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
+#include "devices/timer.h"
 #ifdef USERPROG
 #include "userprog/process.h"
 #endif
@@ -28,12 +30,34 @@
    Do not modify this value. */
 #define THREAD_BASIC 0xd42df210
 
-/* List of processes in THREAD_READY state, that is, processes
-   that are ready to run but not actually running. */
-static struct list ready_list;
-
-/* Idle thread. */
-static struct thread *idle_thread;
+/* Maximum number of lock holders a donation passes through.
+   Bounds the time spent with interrupts off in lock_acquire(),
+   and ends donation through a cycle of waiting threads. */
+#define DONATE_DEPTH_MAX 8
+
+/* Timer ticks between recomputations of the running thread's
+   priority under the multi-level feedback queue scheduler. */
+#define MLFQS_PRIORITY_TICKS 4
+
+/* Each processor in struct cpu (see smp.h) has run queues that
+   hold processes in THREAD_READY state, that is, processes that
+   are ready to run but not actually running, one queue per
+   priority.  Bit P of a processor's READY_MASK is set if and
+   only if its READY_QUEUES[P] is nonempty, so the
+   highest-priority ready thread is found in constant time per
+   processor.
+
+   A thread that becomes ready goes on the queues of the
+   processor that readies it, but any processor may run it: a
+   processor that reschedules takes the highest-priority ready
+   thread from all the queues, its own first among equals.  All
+   the queues are protected by the kernel lock, that is, by
+   turning interrupts off. */
+
+/* System load average, for the multi-level feedback queue
+   scheduler: an estimate of the number of threads ready to run
+   over the past minute. */
+static fixed_t load_avg;
 
 /* Initial thread, the thread running init.c:main(). */
 static struct thread *initial_thread;
@@ -60,7 +84,6 @@ static long long user_ticks;    /* # of timer ticks in user programs. */
 
 /* Scheduling. */
 #define TIME_SLICE 4            /* # of timer ticks to give each thread. */
-static unsigned thread_ticks;   /* # of timer ticks since last yield. */
 
 /* If false (default), use round-robin scheduler.
    If true, use multi-level feedback queue scheduler.
@@ -70,11 +93,20 @@ bool thread_mlfqs;
 static void kernel_thread (thread_func *, void *aux);
 
 static void idle (void *aux UNUSED);
+static void idle_loop (void) NO_RETURN;
 static struct thread *running_thread (void);
 static struct thread *next_thread_to_run (void);
+static void init_cpu (struct cpu *);
 static void init_thread (struct thread *, const char *name, int priority);
 static bool is_thread (struct thread *) UNUSED;
 static void *alloc_frame (struct thread *, size_t size);
+static void ready_push (struct thread *);
+static void wake_cpu (const struct thread *);
+static void change_priority (struct thread *, int priority);
+static int mlfqs_priority (const struct thread *);
+static void mlfqs_update_second (void);
+static int queue_max_priority (const struct cpu *);
+static int ready_max_priority (void);
 static void schedule (void);
 void schedule_tail (struct thread *prev);
 static tid_t allocate_tid (void);
@@ -85,18 +117,21 @@ static struct list all_thread;
 struct thread *
 get_thread(int tid)
 {
-  struct thread * result;
+  struct thread * result = NULL;
   struct list_elem * e;
+  enum intr_level old_level;
 
+  old_level = intr_disable ();
   for(e=list_begin(&all_thread);e!=list_end(&all_thread);e=list_next(e))
   {
-    result = list_entry(e,struct thread,all_elem);
-    if(result->tid == tid)
+    if(list_entry(e,struct thread,all_elem)->tid == tid)
     {
-      return result;
+      result = list_entry(e,struct thread,all_elem);
+      break;
     }
   }
-  return NULL;
+  intr_set_level (old_level);
+  return result;
 }
 
 struct thread *
@@ -136,7 +171,8 @@ thread_init (void)
   ASSERT (intr_get_level () == INTR_OFF);
 
   lock_init (&tid_lock);
-  list_init (&ready_list);
+  init_cpu (&cpus[0]);
+  load_avg = 0;
   list_init(&all_thread);
 
   /* Set up a thread structure for the running thread. */
@@ -144,6 +180,7 @@ thread_init (void)
   init_thread (initial_thread, "main", PRI_DEFAULT);
   initial_thread->status = THREAD_RUNNING;
   initial_thread->tid = allocate_tid ();
+  cpus[0].curr = initial_thread;
 }
 
 /* Starts preemptive thread scheduling by enabling interrupts.
@@ -163,15 +200,49 @@ thread_start (void)
   sema_down (&idle_started);
 }
 
+/* Sets up CPU's scheduler state and its idle thread, with which
+   it starts, to boot it as an application processor.  Returns
+   the idle thread, or a null pointer if memory allocation
+   fails. */
+struct thread *
+thread_create_idle (struct cpu *cpu)
+{
+  struct thread *t = palloc_get_page (PAL_ZERO);
+
+  if (t == NULL)
+    return NULL;
+
+  init_cpu (cpu);
+  init_thread (t, "idle", PRI_MIN);
+  t->tid = allocate_tid ();
+  t->cpu = cpu;
+  t->status = THREAD_RUNNING;
+  cpu->curr = cpu->idle_thread = t;
+  return t;
+}
+
+/* Starts scheduling on an application processor, from the idle
+   thread that thread_create_idle() set up.  Interrupts must be
+   off. */
+void
+thread_start_ap (void)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  cpu_current ()->started = true;
+  idle_loop ();
+}
+
 /* Called by the timer interrupt handler at each timer tick.
    Thus, this function runs in an external interrupt context. */
 void
 thread_tick (void) 
 {
+  struct cpu *cpu = cpu_current ();
   struct thread *t = thread_current ();
 
   /* Update statistics. */
-  if (t == idle_thread)
+  if (t == cpu->idle_thread)
     idle_ticks++;
 #ifdef USERPROG
   else if (t->pagedir != NULL)
@@ -180,11 +251,77 @@ thread_tick (void)
   else
     kernel_ticks++;
 
+  if (thread_mlfqs)
+    {
+      int64_t ticks = timer_ticks ();
+
+      if (t != cpu->idle_thread)
+        t->recent_cpu = fix_add_int (t->recent_cpu, 1);
+      if (ticks % TIMER_FREQ == 0 && cpu == &cpus[0])
+        mlfqs_update_second ();
+      else if (ticks % MLFQS_PRIORITY_TICKS == 0 && t != cpu->idle_thread)
+        change_priority (t, mlfqs_priority (t));
+      thread_preempt ();
+    }
+
   /* Enforce preemption. */
-  if (++thread_ticks >= TIME_SLICE)
+  if (++cpu->thread_ticks >= TIME_SLICE)
     intr_yield_on_return ();
 }
 
+/* Returns T's priority under the multi-level feedback queue
+   scheduler, computed from its recent_cpu and nice values. */
+static int
+mlfqs_priority (const struct thread *t)
+{
+  int priority = PRI_MAX - fix_trunc (t->recent_cpu / 4) - t->nice * 2;
+
+  if (priority < PRI_MIN)
+    return PRI_MIN;
+  else if (priority > PRI_MAX)
+    return PRI_MAX;
+  else
+    return priority;
+}
+
+/* Once-per-second work of the multi-level feedback queue
+   scheduler, run from the timer interrupt.  Updates load_avg,
+   then decays every thread's recent_cpu and recomputes its
+   priority.  This is the only time a thread's priority changes
+   other than the running thread's, whose recent_cpu grows every
+   tick, so the every-fourth-tick recomputation only has to visit
+   the running thread.  The decay coefficient is the same for all
+   threads, so it is computed once, leaving one multiplication
+   per thread.  Only the bootstrap processor runs it. */
+static void
+mlfqs_update_second (void)
+{
+  int ready_threads = 0;
+  fixed_t twice_load;
+  fixed_t decay;
+  struct list_elem *e;
+  unsigned i;
+
+  for (i = 0; i < cpu_cnt; i++)
+    ready_threads += cpus[i].ready_cnt
+                     + (cpus[i].curr != cpus[i].idle_thread);
+  load_avg = (59 * load_avg + fix_int (ready_threads)) / 60;
+  twice_load = 2 * load_avg;
+  decay = fix_div (twice_load, fix_add_int (twice_load, 1));
+
+  for (e = list_begin (&all_thread); e != list_end (&all_thread);
+       e = list_next (e))
+    {
+      struct thread *t = list_entry (e, struct thread, all_elem);
+
+      if (t == t->cpu->idle_thread)
+        continue;
+      t->recent_cpu = fix_add_int (fix_mul (decay, t->recent_cpu), t->nice);
+      if (t->status != THREAD_DYING)
+        change_priority (t, mlfqs_priority (t));
+    }
+}
+
 /* Prints thread statistics. */
 void
 thread_print_stats (void) 
@@ -205,9 +342,8 @@ thread_print_stats (void)
    scheduled.  Use a semaphore or some other form of
    synchronization if you need to ensure ordering.
 
-   The code provided sets the new thread's `priority' member to
-   PRIORITY, but no actual priority scheduling is implemented.
-   Priority scheduling is the goal of Problem 1-3. */
+   If PRIORITY is higher than the running thread's priority, the
+   new thread runs before thread_create() returns. */
 tid_t
 thread_create (const char *name, int priority,
                thread_func *function, void *aux) 
@@ -277,10 +413,11 @@ thread_block (void)
    This is an error if T is not blocked.  (Use thread_yield() to
    make the running thread ready.)
 
-   This function does not preempt the running thread.  This can
-   be important: if the caller had disabled interrupts itself,
-   it may expect that it can atomically unblock a thread and
-   update other data. */
+   If T has a higher priority than the running thread, the
+   running thread is preempted, but only once interrupts are on:
+   if the caller had disabled interrupts itself, it may expect
+   that it can atomically unblock a thread and update other
+   data. */
 void
 thread_unblock (struct thread *t) 
 {
@@ -290,9 +427,41 @@ thread_unblock (struct thread *t)
 
   old_level = intr_disable ();
   ASSERT (t->status == THREAD_BLOCKED);
-  list_push_back (&ready_list, &t->elem);
+  ready_push (t);
   t->status = THREAD_READY;
+  wake_cpu (t);
   intr_set_level (old_level);
+  thread_preempt ();
+}
+
+/* Yields the CPU if a thread of higher priority than the running
+   thread is ready.  Within an interrupt handler, the yield
+   happens just before returning from the interrupt.  If
+   interrupts are disabled, nothing happens: the caller is
+   expected to call this function again after turning them back
+   on, as sema_up() does. */
+void
+thread_preempt (void)
+{
+  struct cpu *cpu = cpu_current ();
+  struct thread *curr = thread_current ();
+  bool preempt;
+
+  if (intr_context ())
+    {
+      if (ready_max_priority () > curr->priority
+          || (curr == cpu->idle_thread && ready_max_priority () >= 0))
+        intr_yield_on_return ();
+      return;
+    }
+  if (intr_get_level () == INTR_OFF)
+    return;
+
+  intr_disable ();
+  preempt = ready_max_priority () > curr->priority;
+  intr_enable ();
+  if (preempt)
+    thread_yield ();
 }
 
 /* Returns the name of the running thread. */
@@ -347,10 +516,10 @@ thread_exit (void)
   //printf("thread_exit - sema_up\n");
   sema_down(&thread_current()->sema_destroy);
 
-  list_remove(&thread_current()->all_elem);
   /* Just set our status to dying and schedule another process.
      We will be destroyed during the call to schedule_tail(). */
   intr_disable ();
+  list_remove(&thread_current()->all_elem);
   thread_current ()->status = THREAD_DYING;
   schedule ();
   NOT_REACHED ();
@@ -361,24 +530,100 @@ thread_exit (void)
 void
 thread_yield (void) 
 {
+  struct cpu *cpu = cpu_current ();
   struct thread *curr = thread_current ();
   enum intr_level old_level;
   
   ASSERT (!intr_context ());
 
   old_level = intr_disable ();
-  if (curr != idle_thread) 
-    list_push_back (&ready_list, &curr->elem);
+  if (curr != cpu->idle_thread) 
+    ready_push (curr);
   curr->status = THREAD_READY;
   schedule ();
   intr_set_level (old_level);
 }
 
-/* Sets the current thread's priority to NEW_PRIORITY. */
+/* Sets the current thread's base priority to NEW_PRIORITY, and
+   yields if it no longer has the highest priority.  Priority
+   donated to the thread still applies until the locks it holds
+   are released.  Does nothing under MLFQS, which sets
+   priorities itself. */
 void
 thread_set_priority (int new_priority) 
 {
-  thread_current ()->priority = new_priority;
+  enum intr_level old_level;
+
+  ASSERT (new_priority >= PRI_MIN && new_priority <= PRI_MAX);
+
+  if (thread_mlfqs)
+    return;
+
+  old_level = intr_disable ();
+  thread_current ()->base_priority = new_priority;
+  thread_update_priority (thread_current ());
+  intr_set_level (old_level);
+  thread_preempt ();
+}
+
+/* Donates DONOR's priority to the holder of the lock DONOR waits
+   for, then to the holder of the lock that one waits for, and so
+   on, up to DONATE_DEPTH_MAX holders deep.  Stops early at a
+   holder that already has at least DONOR's priority.  There is
+   no donation under MLFQS.  Interrupts must be off. */
+void
+thread_donate_priority (struct thread *donor)
+{
+  struct lock *lock = donor->wait_lock;
+  int depth;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (thread_mlfqs)
+    return;
+
+  for (depth = 0; lock != NULL && depth < DONATE_DEPTH_MAX; depth++)
+    {
+      struct thread *holder = lock->holder;
+
+      if (holder == NULL || holder->priority >= donor->priority)
+        break;
+      change_priority (holder, donor->priority);
+      lock = holder->wait_lock;
+    }
+}
+
+/* Recomputes T's priority as the highest of its base priority
+   and the priorities of the threads waiting for locks it holds.
+   Called when T releases a lock or gains waiters for one.
+   Interrupts must be off. */
+void
+thread_update_priority (struct thread *t)
+{
+  int priority = t->base_priority;
+  struct list_elem *e;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (thread_mlfqs)
+    return;
+
+  for (e = list_begin (&t->held_locks); e != list_end (&t->held_locks);
+       e = list_next (e))
+    {
+      struct list *waiters = &list_entry (e, struct lock, elem)
+                               ->semaphore.waiters;
+      struct list_elem *w;
+
+      for (w = list_begin (waiters); w != list_end (waiters);
+           w = list_next (w))
+        {
+          struct thread *waiter = list_entry (w, struct thread, elem);
+          if (waiter->priority > priority)
+            priority = waiter->priority;
+        }
+    }
+  change_priority (t, priority);
 }
 
 /* Returns the current thread's priority. */
@@ -388,35 +633,50 @@ thread_get_priority (void)
   return thread_current ()->priority;
 }
 
-/* Sets the current thread's nice value to NICE. */
+/* Sets the current thread's nice value to NICE, recomputes its
+   priority, and yields if it no longer has the highest
+   priority. */
 void
-thread_set_nice (int nice UNUSED) 
+thread_set_nice (int nice) 
 {
-  /* Not yet implemented. */
+  struct thread *curr = thread_current ();
+  enum intr_level old_level;
+
+  ASSERT (nice >= NICE_MIN && nice <= NICE_MAX);
+
+  old_level = intr_disable ();
+  curr->nice = nice;
+  if (thread_mlfqs)
+    change_priority (curr, mlfqs_priority (curr));
+  intr_set_level (old_level);
+  thread_preempt ();
 }
 
 /* Returns the current thread's nice value. */
 int
 thread_get_nice (void) 
 {
-  /* Not yet implemented. */
-  return 0;
+  return thread_current ()->nice;
 }
 
 /* Returns 100 times the system load average. */
 int
 thread_get_load_avg (void) 
 {
-  /* Not yet implemented. */
-  return 0;
+  enum intr_level old_level = intr_disable ();
+  int load = fix_round (load_avg * 100);
+  intr_set_level (old_level);
+  return load;
 }
 
 /* Returns 100 times the current thread's recent_cpu value. */
 int
 thread_get_recent_cpu (void) 
 {
-  /* Not yet implemented. */
-  return 0;
+  enum intr_level old_level = intr_disable ();
+  int recent = fix_round (thread_current ()->recent_cpu * 100);
+  intr_set_level (old_level);
+  return recent;
 }
 
 /* Idle thread.  Executes when no other thread is ready to run.
@@ -431,29 +691,26 @@ thread_get_recent_cpu (void)
 static void
 idle (void *idle_started_ UNUSED) 
 {
+  struct cpu *cpu = cpu_current ();
   struct semaphore *idle_started = idle_started_;
-  idle_thread = thread_current ();
+  cpu->idle_thread = thread_current ();
   sema_up (idle_started);
 
+  idle_loop ();
+}
+
+/* Body of every processor's idle thread. */
+static void
+idle_loop (void)
+{
   for (;;) 
     {
       /* Let someone else run. */
       intr_disable ();
       thread_block ();
 
-      /* Re-enable interrupts and wait for the next one.
-
-         The `sti' instruction disables interrupts until the
-         completion of the next instruction, so these two
-         instructions are executed atomically.  This atomicity is
-         important; otherwise, an interrupt could be handled
-         between re-enabling interrupts and waiting for the next
-         one to occur, wasting as much as one clock tick worth of
-         time.
-
-         See [IA32-v2a] "HLT", [IA32-v2b] "STI", and [IA32-v3a]
-         7.11.1 "HLT Instruction". */
-      asm volatile ("sti; hlt" : : : "memory");
+      /* Re-enable interrupts and wait for the next one. */
+      intr_wait ();
     }
 }
 
@@ -482,6 +739,16 @@ running_thread (void)
   return pg_round_down (esp);
 }
 
+/* Returns the running processor.  Before thread_init() has set
+   up the initial thread, that is the bootstrap processor. */
+struct cpu *
+cpu_current (void)
+{
+  struct thread *t = running_thread ();
+
+  return is_thread (t) ? t->cpu : &cpus[0];
+}
+
 /* Returns true if T appears to point to a valid thread. */
 static bool
 is_thread (struct thread *t)
@@ -494,6 +761,8 @@ is_thread (struct thread *t)
 static void
 init_thread (struct thread *t, const char *name, int priority)
 {
+  enum intr_level old_level;
+
   ASSERT (t != NULL);
   ASSERT (PRI_MIN <= priority && priority <= PRI_MAX);
   ASSERT (name != NULL);
@@ -502,13 +771,28 @@ init_thread (struct thread *t, const char *name, int priority)
   t->status = THREAD_BLOCKED;
   strlcpy (t->name, name, sizeof t->name);
   t->stack = (uint8_t *) t + PGSIZE;
-  t->priority = priority;
+  t->priority = t->base_priority = priority;
+
+  /* A new thread inherits its creator's nice and recent_cpu
+     values, which set its priority under MLFQS. */
+  if (t != running_thread ())
+    {
+      t->nice = running_thread ()->nice;
+      t->recent_cpu = running_thread ()->recent_cpu;
+    }
+  if (thread_mlfqs)
+    t->priority = t->base_priority = mlfqs_priority (t);
+  list_init (&t->held_locks);
+  t->wait_lock = NULL;
+  t->cpu = cpu_current ();
   t->magic = THREAD_MAGIC;
 
   /*project2*/
   list_init(&t->file_list);
   t->fd = 2;
+  old_level = intr_disable ();
   list_push_back(&all_thread,&t->all_elem);
+  intr_set_level (old_level);
   list_init(&t->child_list);
   t->exit_status = NULL;
   sema_init(&t->sema_wait, 0);
@@ -518,8 +802,12 @@ init_thread (struct thread *t, const char *name, int priority)
   t->load_status = false;
 
   /*project3*/
+  lock_init(&t->page_table_lock);
+  cond_init(&t->page_transit);
   list_init(&t->mmap_list);
   t->map_id = 1;
+  t->fault_next = NULL;
+  t->fault_window = 0;
 
 }
 
@@ -536,18 +824,157 @@ alloc_frame (struct thread *t, size_t size)
   return t->stack;
 }
 
+/* Initializes CPU's run queues. */
+static void
+init_cpu (struct cpu *cpu)
+{
+  int i;
+
+  for (i = PRI_MIN; i <= PRI_MAX; i++)
+    list_init (&cpu->ready_queues[i]);
+  cpu->ready_mask = 0;
+  cpu->ready_cnt = 0;
+}
+
 /* Chooses and returns the next thread to be scheduled.  Should
-   return a thread from the run queue, unless the run queue is
+   return a thread from a run queue, unless the run queues are
    empty.  (If the running thread can continue running, then it
-   will be in the run queue.)  If the run queue is empty, return
-   idle_thread. */
+   will be in a run queue.)  If the run queues are empty, return
+   the running processor's idle_thread.  The highest-priority
+   thread is taken from the running processor's queues, unless
+   another processor's has a higher one. */
 static struct thread *
 next_thread_to_run (void) 
 {
-  if (list_empty (&ready_list))
-    return idle_thread;
+  struct cpu *cpu = cpu_current ();
+  struct cpu *from = cpu;
+  int priority = queue_max_priority (cpu);
+  struct thread *t;
+  unsigned i;
+
+  for (i = 0; i < cpu_cnt; i++)
+    if (queue_max_priority (&cpus[i]) > priority)
+      {
+        from = &cpus[i];
+        priority = queue_max_priority (from);
+      }
+  if (priority < 0)
+    return cpu->idle_thread;
+
+  t = list_entry (list_pop_front (&from->ready_queues[priority]),
+                  struct thread, elem);
+  from->ready_cnt--;
+  if (list_empty (&from->ready_queues[priority]))
+    from->ready_mask &= ~((uint64_t) 1 << priority);
+  return t;
+}
+
+/* Adds T to the back of the running processor's run queue for
+   its priority.  Interrupts must be off. */
+static void
+ready_push (struct thread *t)
+{
+  struct cpu *cpu = cpu_current ();
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (t->priority >= PRI_MIN && t->priority <= PRI_MAX);
+
+  list_push_back (&cpu->ready_queues[t->priority], &t->elem);
+  cpu->ready_cnt++;
+  cpu->ready_mask |= (uint64_t) 1 << t->priority;
+  t->cpu = cpu;
+}
+
+/* Asks another processor to run T, which has just become ready,
+   unless the running processor is about to: an idle processor
+   if there is one, otherwise the one running the
+   lowest-priority thread, if that is lower than T's.
+   Interrupts must be off. */
+static void
+wake_cpu (const struct thread *t)
+{
+  struct cpu *cpu = cpu_current ();
+  struct cpu *target = NULL;
+  unsigned i;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (cpu->curr == cpu->idle_thread || cpu->curr->priority < t->priority)
+    return;
+
+  for (i = 0; i < cpu_cnt; i++)
+    {
+      struct cpu *c = &cpus[i];
+
+      if (c == cpu)
+        continue;
+      if (c->curr == c->idle_thread)
+        {
+          target = c;
+          break;
+        }
+      if (c->curr->priority < t->priority
+          && (target == NULL || c->curr->priority < target->curr->priority))
+        target = c;
+    }
+  if (target != NULL)
+    smp_resched (target);
+}
+
+/* Sets T's priority to PRIORITY, moving T to the matching run
+   queue if it is ready.  Interrupts must be off. */
+static void
+change_priority (struct thread *t, int priority)
+{
+  struct cpu *cpu = t->cpu;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (t->status == THREAD_READY && t != cpu->idle_thread)
+    {
+      list_remove (&t->elem);
+      cpu->ready_cnt--;
+      if (list_empty (&cpu->ready_queues[t->priority]))
+        cpu->ready_mask &= ~((uint64_t) 1 << t->priority);
+      t->priority = priority;
+      list_push_back (&cpu->ready_queues[priority], &t->elem);
+      cpu->ready_cnt++;
+      cpu->ready_mask |= (uint64_t) 1 << priority;
+    }
+  else
+    t->priority = priority;
+}
+
+/* Returns the priority of the highest-priority thread in CPU's
+   run queues, or -1 if they are empty.  READY_MASK is searched
+   one 32-bit half at a time, so that each search is a single bsr
+   instruction and no libgcc helper is needed. */
+static int
+queue_max_priority (const struct cpu *cpu)
+{
+  uint32_t high = cpu->ready_mask >> 32;
+  uint32_t low = cpu->ready_mask;
+
+  if (high != 0)
+    return 63 - __builtin_clz (high);
+  else if (low != 0)
+    return 31 - __builtin_clz (low);
   else
-    return list_entry (list_pop_front (&ready_list), struct thread, elem);
+    return -1;
+}
+
+/* Returns the priority of the highest-priority ready thread on
+   any processor, or -1 if no thread is ready. */
+static int
+ready_max_priority (void)
+{
+  int priority = -1;
+  unsigned i;
+
+  for (i = 0; i < cpu_cnt; i++)
+    if (queue_max_priority (&cpus[i]) > priority)
+      priority = queue_max_priority (&cpus[i]);
+  return priority;
 }
 
 /* Completes a thread switch by activating the new thread's page
@@ -569,6 +996,7 @@ next_thread_to_run (void)
 void
 schedule_tail (struct thread *prev) 
 {
+  struct cpu *cpu = cpu_current ();
   struct thread *curr = running_thread ();
   
   ASSERT (intr_get_level () == INTR_OFF);
@@ -577,7 +1005,7 @@ schedule_tail (struct thread *prev)
   curr->status = THREAD_RUNNING;
 
   /* Start new time slice. */
-  thread_ticks = 0;
+  cpu->thread_ticks = 0;
 
 #ifdef USERPROG
   /* Activate the new address space. */
@@ -606,6 +1034,7 @@ schedule_tail (struct thread *prev)
 static void
 schedule (void) 
 {
+  struct cpu *cpu = cpu_current ();
   struct thread *curr = running_thread ();
   struct thread *next = next_thread_to_run ();
   struct thread *prev = NULL;
@@ -614,6 +1043,9 @@ schedule (void)
   ASSERT (curr->status != THREAD_RUNNING);
   ASSERT (is_thread (next));
 
+  /* NEXT may come from another processor's run queue. */
+  next->cpu = cpu;
+  cpu->curr = next;
   if (curr != next)
     prev = switch_threads (curr, next);
   schedule_tail (prev); 
@@ -6,8 +6,11 @@
 #include <stdint.h>
 #include <hash.h>
 #include "synch.h"
+#include "threads/fixed-point.h"
 #include "filesys/file.h"
 
+struct cpu;
+
 /* States in a thread's life cycle. */
 enum thread_status
   {
@@ -27,6 +30,12 @@ typedef int tid_t;
 #define PRI_DEFAULT 31                  /* Default priority. */
 #define PRI_MAX 63                      /* Highest priority. */
 
+/* Thread niceness, for the multi-level feedback queue
+   scheduler. */
+#define NICE_MIN -20                    /* Least nice to other threads. */
+#define NICE_DEFAULT 0                  /* Default niceness. */
+#define NICE_MAX 20                     /* Nicest. */
+
 /* A kernel thread or user process.
 
    Each thread structure is stored in its own 4 kB page.  The
@@ -78,11 +87,12 @@ typedef int tid_t;
    set to THREAD_MAGIC.  Stack overflow will normally change this
    value, triggering the assertion. */
 /* The `elem' member has a dual purpose.  It can be an element in
-   the run queue (thread.c), or it can be an element in a
-   semaphore wait list (synch.c).  It can be used these two ways
-   only because they are mutually exclusive: only a thread in the
-   ready state is on the run queue, whereas only a thread in the
-   blocked state is on a semaphore wait list. */
+   the run queue for its priority (thread.c), or it can be an
+   element in a semaphore wait list (synch.c) or in the sleep
+   list (devices/timer.c).  It can be used these ways only because
+   they are mutually exclusive: only a thread in the ready state
+   is on the run queue, whereas only a thread in the blocked
+   state is on a semaphore wait list or asleep, and never both. */
 struct thread
   {
     /* Owned by thread.c. */
@@ -90,10 +100,19 @@ struct thread
     enum thread_status status;          /* Thread state. */
     char name[16];                      /* Name (for debugging purposes). */
     uint8_t *stack;                     /* Saved stack pointer. */
-    int priority;                       /* Priority. */
+    int priority;                       /* Priority, including donations. */
+    int base_priority;                  /* Priority set by the thread. */
+    int nice;                           /* Niceness, for MLFQS. */
+    fixed_t recent_cpu;                 /* Recent CPU time, for MLFQS. */
+    struct cpu *cpu;                    /* Processor running or queuing it. */
 
     /* Shared between thread.c and synch.c. */
     struct list_elem elem;              /* List element. */
+    struct list held_locks;             /* Locks held, for donation. */
+    struct lock *wait_lock;             /* Lock being waited on, if any. */
+
+    /* Owned by devices/timer.c. */
+    int64_t wake_tick;                  /* Tick to wake up at, if asleep. */
 
     /*[project2]*/
     int fd;                             /*file discriptor [project2-syscall] */
@@ -110,9 +129,13 @@ struct thread
 
     /*[project3]*/
     struct hash page_table;
+    struct lock page_table_lock;        /* Protects page_table. */
+    struct condition page_transit;      /* Signaled when a page lands. */
     void *esp;
     struct list mmap_list;
     int map_id;
+    void *fault_next;                   /* Page a sequential fault hits next. */
+    int fault_window;                   /* Pages mapped around a file fault. */
 
 
 #ifdef USERPROG
@@ -132,6 +155,8 @@ extern bool thread_mlfqs;
 
 void thread_init (void);
 void thread_start (void);
+struct thread *thread_create_idle (struct cpu *);
+void thread_start_ap (void) NO_RETURN;
 
 void thread_tick (void);
 void thread_print_stats (void);
@@ -148,6 +173,9 @@ const char *thread_name (void);
 
 void thread_exit (void) NO_RETURN;
 void thread_yield (void);
+void thread_preempt (void);
+void thread_donate_priority (struct thread *);
+void thread_update_priority (struct thread *);
 
 int thread_get_priority (void);
 void thread_set_priority (int);
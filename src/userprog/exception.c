@@ -10,25 +10,41 @@
 #include "threads/palloc.h"
 #include "threads/synch.h"
 #include "userprog/syscall.h"
+#include <syscall-nr.h>
 
 #ifdef VM
 #include "vm/page.h"
 #include "vm/frame.h"
 #include "vm/swap.h"
+#include "vm/share.h"
 #endif
 
 #define MAX_STACK_SIZE (1<<23)
 
+/* Largest number of pages mapped ahead of a file fault. */
+#define FAULT_AROUND_MAX 16
+
+/* Free frames that mapping ahead never takes.  Fixed rather
+   than tied to the page-out watermarks, which may be zero. */
+#define FAULT_AROUND_RESERVE 32
+
+/* Distance in pages behind a sequential reader at which its mmap
+   pages are dropped. */
+#define DROP_BEHIND 16
+
 /* Number of page faults processed. */
 static long long page_fault_cnt;
 
+/* Number of pages mapped ahead of a fault. */
+static long long fault_around_cnt;
+
 static void kill (struct intr_frame *);
 static void page_fault (struct intr_frame *);
 bool page_fault_process(void *fault_addr);
 bool lazy_load_file(struct page_table_entry *pte);
 bool lazy_load_mmap(struct page_table_entry *pte);
-
-struct lock lock_page_fault;
+static void fault_around(struct page_table_entry *pte);
+static void drop_behind(struct page_table_entry *pte);
 
 /* Registers handlers for interrupts that can be caused by user
    programs.
@@ -77,8 +93,6 @@ exception_init (void)
      We need to disable interrupts for page faults because the
      fault address is stored in CR2 and needs to be preserved. */
   intr_register_int (14, 0, INTR_OFF, page_fault, "#PF Page-Fault Exception");
-
-  lock_init(&lock_page_fault);
 }
 
 /* Prints exception statistics. */
@@ -86,6 +100,9 @@ void
 exception_print_stats (void) 
 {
   printf ("Exception: %lld page faults\n", page_fault_cnt);
+#ifdef VM
+  printf ("Fault-around: %lld pages mapped ahead\n", fault_around_cnt);
+#endif
 }
 
 /* Handler for an exception (probably) caused by a user process. */
@@ -181,6 +198,12 @@ page_fault (struct intr_frame *f)
 
   /*읽기 전용 페이지에 쓰기를 시도할 경우*/
   if(!not_present){
+    /* Unless the page is only shared copy-on-write since fork. */
+    if(write && is_user_vaddr(fault_addr)){
+      success = page_cow_fault(fault_addr);
+      if(success)
+        return;
+    }
     //printf("write to read only page\n");
     exit(-1);
   }
@@ -191,9 +214,7 @@ page_fault (struct intr_frame *f)
     exit(-1);
   }
 
-  lock_acquire(&lock_page_fault);
   success = page_fault_process(fault_addr);
-  lock_release(&lock_page_fault);
   if(!success)
     exit(-1);
 
@@ -214,18 +235,24 @@ page_fault (struct intr_frame *f)
 #endif
 }
 
+/*
+Brings in the page at FAULT_ADDR.  The current thread's page table
+is only locked to look the page up and to mark it in transit; the
+frame allocation and the I/O run unlocked, so that faults of other
+processes, and evictions of our other pages, go on meanwhile.
+*/
 bool 
 page_fault_process(void *fault_addr){
   bool success = false;
-  struct frame *frame;
   struct page_table_entry *pte;
   struct thread *curr = thread_current();
-  void *check_page;
 
+  lock_acquire(&curr->page_table_lock);
   pte = page_table_find(fault_addr, curr);
   //printf("adfasd\n");
 
   if(pte == NULL){
+    lock_release(&curr->page_table_lock);
    //printf("you should make stack expand\n");
     if(fault_addr < curr->esp - 32){
       //printf("fault_addr = %x curr->esp - 32 = %x\n", fault_addr, curr->esp-32);
@@ -245,47 +272,162 @@ page_fault_process(void *fault_addr){
   }
 
   else{
-    pte->accessable = false;
-    if(pte->type == PTE_FRAME){
-      //printf("swap_in\n");
-      success = swap_in(pte);
-    }
-    
-    else if(pte->type == PTE_FILE){
-      success = lazy_load_file(pte);
-    }
-
-    else if(pte->type == PTE_MMAP){
-      //printf("lazy_load_mmap\n");
-      success = lazy_load_mmap(pte);
-    }
-      
-    pte->accessable = true;
+    lock_release(&curr->page_table_lock);
+    success = page_load(pte);
     if(!success){
       exit(-1);
     }
+    if(pte->type == PTE_FILE || pte->type == PTE_MMAP)
+      fault_around(pte);
+    if(pte->advice == MADV_SEQUENTIAL)
+      drop_behind(pte);
+  }
+
+  return success;
+}
+
+/*
+Brings in the page PTE of the current thread unless it is present
+already.  Also used by madvise(MADV_WILLNEED).
+*/
+bool
+page_load(struct page_table_entry *pte){
+  struct thread *curr = thread_current();
+  bool success = false;
+
+  lock_acquire(&curr->page_table_lock);
+  // an eviction of the page may still be writing it out
+  page_wait(pte);
+  if(pagedir_get_page(curr->pagedir, pte->vaddr) != NULL){
+    lock_release(&curr->page_table_lock);
+    return true;
+  }
+  pte->in_transit = true;
+  lock_release(&curr->page_table_lock);
+
+  if(pte->type == PTE_FRAME){
+    //printf("swap_in\n");
+    success = swap_in(pte);
+  }
+  
+  else if(pte->type == PTE_FILE){
+    success = lazy_load_file(pte);
   }
 
+  else if(pte->type == PTE_MMAP){
+    //printf("lazy_load_mmap\n");
+    success = lazy_load_mmap(pte);
+  }
+
+  lock_acquire(&curr->page_table_lock);
+  pte->in_transit = false;
+  cond_broadcast(&curr->page_transit, &curr->page_table_lock);
+  lock_release(&curr->page_table_lock);
+
   return success;
 }
 
+/*
+Maps the pages following PTE in the same file mapping, so that a
+sequential reader takes one fault per window instead of one per page.
+The window doubles each time a fault lands right after the previous
+window and closes on any other fault.  Only free frames beyond
+FAULT_AROUND_RESERVE are used: pages are never evicted to make room
+for ones nobody asked for.  Each page is read with its own
+file_read_at, so this saves faults, not disk requests.
+*/
+static void
+fault_around(struct page_table_entry *pte){
+  struct thread *curr = thread_current();
+  struct page_table_entry *next;
+  void *vaddr = pte->vaddr + PGSIZE;
+  bool success;
+  int i;
+
+  if(pte->advice == MADV_SEQUENTIAL)
+    curr->fault_window = FAULT_AROUND_MAX;
+  else if(pte->advice == MADV_RANDOM)
+    curr->fault_window = 0;
+  else if(pte->vaddr == curr->fault_next){
+    curr->fault_window = curr->fault_window == 0 ? 1 : curr->fault_window * 2;
+    if(curr->fault_window > FAULT_AROUND_MAX)
+      curr->fault_window = FAULT_AROUND_MAX;
+  }
+  else
+    curr->fault_window = 0;
+
+  for(i = 0; i < curr->fault_window; i++, vaddr += PGSIZE){
+    if(frame_free_cnt() <= FAULT_AROUND_RESERVE)
+      break;
+
+    lock_acquire(&curr->page_table_lock);
+    next = page_table_find(vaddr, curr);
+    if(next == NULL || next->in_transit || next->type != pte->type
+        || next->file != pte->file || next->loaded
+        || pagedir_get_page(curr->pagedir, vaddr) != NULL){
+      lock_release(&curr->page_table_lock);
+      break;
+    }
+    next->in_transit = true;
+    lock_release(&curr->page_table_lock);
+
+    success = next->type == PTE_FILE ? lazy_load_file(next) : lazy_load_mmap(next);
+    // leave the page unaccessed so the clock hand takes it first if unused
+    if(success)
+      pagedir_set_accessed(curr->pagedir, vaddr, false);
+
+    lock_acquire(&curr->page_table_lock);
+    next->in_transit = false;
+    cond_broadcast(&curr->page_transit, &curr->page_table_lock);
+    lock_release(&curr->page_table_lock);
+    if(!success)
+      break;
+    fault_around_cnt++;
+  }
+
+  curr->fault_next = vaddr;
+}
+
+/*
+For a mapping advised MADV_SEQUENTIAL, drops the pages that the
+reader left DROP_BEHIND pages or more behind, which it is not
+expected to touch again, instead of waiting for the clock to find
+them.  Each fault covers up to FAULT_AROUND_MAX + 1 pages, so that
+many are looked at.
+*/
+static void
+drop_behind(struct page_table_entry *pte){
+  struct thread *curr = thread_current();
+  struct page_table_entry *prev;
+  uintptr_t vaddr = (uintptr_t) pte->vaddr;
+  int i;
+
+  lock_acquire(&curr->page_table_lock);
+  for(i = DROP_BEHIND; i <= DROP_BEHIND + FAULT_AROUND_MAX; i++){
+    if(vaddr < (uintptr_t) i * PGSIZE)
+      break;
+    prev = page_table_find((void *) (vaddr - i * PGSIZE), curr);
+    if(prev == NULL || prev->type != PTE_MMAP || prev->file != pte->file)
+      break;
+    if(prev->advice == MADV_SEQUENTIAL)
+      page_drop(prev);
+  }
+  lock_release(&curr->page_table_lock);
+}
+
 bool
 lazy_load_file(struct page_table_entry *pte){
   //printf("lazy_load_file vaddr = %x\n", pte->vaddr);
   //printf("lazy load file addr = %x\n", pte->file);
   struct frame *frame;
 
-  frame = frame_alloc();
+  /* Read-only pages are shared by every process running the binary. */
+  if(!pte->writable)
+    return share_load(pte);
 
-  if(frame == NULL){
-    //printf("lazy_load_file -swap_out\n");
-    if(swap_out()){
-      frame = frame_alloc();
-    }
-    else{
-      return false;
-    }
-  }
+  frame = page_frame_alloc();
+  if(frame == NULL)
+    return false;
 
   if (file_read_at(pte->file, frame->kaddr, pte->read_bytes, pte->offset) 
           != (int) pte->read_bytes){
@@ -297,12 +439,11 @@ lazy_load_file(struct page_table_entry *pte){
   memset(frame->kaddr + pte->read_bytes, 0, pte->zero_bytes);
 
   if (!install_page (pte->vaddr, frame->kaddr, pte->writable)){
-      free(frame);
+      frame_free(frame);
       return false; 
   }
   pte->frame =frame;
   pte->loaded = true;
-  pte->type = PTE_FRAME;
   frame_to_table(frame, pte->vaddr);
 
   //printf("page_fault - file read to frame\n");
@@ -322,34 +463,23 @@ lazy_load_mmap(struct page_table_entry *pte){
   }
   struct frame *frame;
 
-  frame = frame_alloc();
-
-  if(frame == NULL){
-    //printf("lazy_load_mmap - swap_out\n");
-    if(swap_out()){
-      frame = frame_alloc();
-    }
-    else{
-      return false;
-    }
-  }
+  frame = page_frame_alloc();
+  if(frame == NULL)
+    return false;
 
   //printf("lazy_load_mmap -thread = %d vaddr = %x kaddr = %x read_bytes = %d offset = %d\n",thread_current()->tid, pte->vaddr, frame->kaddr, pte->read_bytes, pte->offset);
-  lock_acquire(&lock_filesys);
   if (file_read_at(pte->file, frame->kaddr, pte->read_bytes, pte->offset) 
           != (int) pte->read_bytes){
         printf("mmap didn't read\n");
-        //frame_free(frame);
-      lock_release(&lock_filesys);
+        frame_free(frame);
         return false; 
       }
-  lock_release(&lock_filesys);
 
   memset(frame->kaddr + pte->read_bytes, 0, pte->zero_bytes);
 
   if (!install_page (pte->vaddr, frame->kaddr, pte->writable)){
-      //free(frame);
       printf("lazy_load_mmap - install_page failed\n");
+      frame_free(frame);
       return false; 
   }
   //printf("pagedir_get_page = %x\n", pagedir_get_page(thread_current()->pagedir, pte->vaddr));
@@ -357,10 +487,7 @@ lazy_load_mmap(struct page_table_entry *pte){
 
   pte->frame = frame;
   pte->loaded = true;
-  //pte->type = PTE_FRAME;
-  frame_add(frame);
-  frame->vaddr = pte->vaddr;
-  frame->accessable = false;
+  frame_to_table(frame, pte->vaddr);
 
   //printf("lazy_load_mmap done\n");
 
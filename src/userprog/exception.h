@@ -9,4 +9,11 @@
 void exception_init (void);
 void exception_print_stats (void);
 
+#ifdef VM
+#include <stdbool.h>
+
+struct page_table_entry;
+bool page_load (struct page_table_entry *);
+#endif
+
 #endif /* userprog/exception.h */
@@ -3,8 +3,10 @@
 #include <stddef.h>
 #include <string.h>
 #include "threads/init.h"
+#include "threads/interrupt.h"
 #include "threads/pte.h"
 #include "threads/palloc.h"
+#include "threads/smp.h"
 
 static uint32_t *active_pd (void);
 static void invalidate_pagedir (uint32_t *);
@@ -139,7 +141,12 @@ pagedir_get_page (uint32_t *pd, const void *uaddr)
 /* Marks user virtual page UPAGE "not present" in page
    directory PD.  Later accesses to the page will fault.  Other
    bits in the page table entry are preserved.
-   UPAGE need not be mapped. */
+   UPAGE need not be mapped.
+
+   PD may be active on another processor, whose MMU may set the
+   accessed and dirty bits in the page table entry at any time,
+   so this and the functions below change entries with locked
+   read-modify-write instructions, which do not lose those bits. */
 void
 pagedir_clear_page (uint32_t *pd, void *upage) 
 {
@@ -151,7 +158,7 @@ pagedir_clear_page (uint32_t *pd, void *upage)
   pte = lookup_page (pd, upage, false);
   if (pte != NULL && (*pte & PTE_P) != 0)
     {
-      *pte &= ~PTE_P;
+      __sync_fetch_and_and (pte, ~(uint32_t) PTE_P);
       invalidate_pagedir (pd);
     }
 }
@@ -176,15 +183,32 @@ pagedir_set_dirty (uint32_t *pd, const void *vpage, bool dirty)
   if (pte != NULL) 
     {
       if (dirty)
-        *pte |= PTE_D;
+        __sync_fetch_and_or (pte, PTE_D);
       else 
         {
-          *pte &= ~(uint32_t) PTE_D;
+          __sync_fetch_and_and (pte, ~(uint32_t) PTE_D);
           invalidate_pagedir (pd);
         }
     }
 }
 
+/* Makes the PTE for virtual page VPAGE in PD read/write if
+   WRITABLE is true, read-only otherwise.  The accessed and dirty
+   bits are preserved. */
+void
+pagedir_set_writable (uint32_t *pd, const void *vpage, bool writable) 
+{
+  uint32_t *pte = lookup_page (pd, vpage, false);
+  if (pte != NULL) 
+    {
+      if (writable)
+        __sync_fetch_and_or (pte, PTE_W);
+      else 
+        __sync_fetch_and_and (pte, ~(uint32_t) PTE_W);
+      invalidate_pagedir (pd);
+    }
+}
+
 /* Returns true if the PTE for virtual page VPAGE in PD has been
    accessed recently, that is, between the time the PTE was
    installed and the last time it was cleared.  Returns false if
@@ -205,29 +229,40 @@ pagedir_set_accessed (uint32_t *pd, const void *vpage, bool accessed)
   if (pte != NULL) 
     {
       if (accessed)
-        *pte |= PTE_A;
+        __sync_fetch_and_or (pte, PTE_A);
       else 
         {
-          *pte &= ~(uint32_t) PTE_A; 
+          __sync_fetch_and_and (pte, ~(uint32_t) PTE_A);
           invalidate_pagedir (pd);
         }
     }
 }
 
 /* Loads page directory PD into the CPU's page directory base
-   register. */
+   register, and records it as the running processor's, for
+   smp_tlb_shootdown(). */
 void
 pagedir_activate (uint32_t *pd) 
 {
+  enum intr_level old_level;
+
   if (pd == NULL)
     pd = base_page_dir;
 
+  /* Keep the thread on one processor in between, and record PD
+     before loading it, so that a processor that changes PD's
+     entries after we load it knows to interrupt us. */
+  old_level = intr_disable ();
+  cpu_current ()->pagedir = pd;
+  __sync_synchronize ();
+
   /* Store the physical address of the page directory into CR3
      aka PDBR (page directory base register).  This activates our
      new page tables immediately.  See [IA32-v2a] "MOV--Move
      to/from Control Registers" and [IA32-v3a] 3.7.5 "Base
      Address of the Page Directory". */
   asm volatile ("movl %0, %%cr3" : : "r" (vtop (pd)) : "memory");
+  intr_set_level (old_level);
 }
 
 /* Returns the currently active page directory. */
@@ -250,7 +285,9 @@ active_pd (void)
 
    This function invalidates the TLB if PD is the active page
    directory.  (If PD is not active then its entries are not in
-   the TLB, so there is no need to invalidate anything.) */
+   the TLB, so there is no need to invalidate anything.)  It
+   does the same for every other processor on which PD is
+   active. */
 static void
 invalidate_pagedir (uint32_t *pd) 
 {
@@ -260,4 +297,5 @@ invalidate_pagedir (uint32_t *pd)
          "Translation Lookaside Buffers (TLBs)". */
       pagedir_activate (pd);
     } 
+  smp_tlb_shootdown (pd);
 }
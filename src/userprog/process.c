@@ -28,6 +28,7 @@ bool install_page (void *upage, void *kpage, bool writable);
 int argument_count(char *parse);
 void argv_put_stack(char *parse,int count, void **esp);
 bool stack_growth(void *vaddr);
+static bool stack_install (struct page_table_entry *pte);
 /* Starts a new thread running a user program loaded from
    FILENAME.  The new thread may be scheduled (and may even exit)
    before process_execute() returns.  Returns the new process's
@@ -111,6 +112,112 @@ start_process (void *cmd_line)
   NOT_REACHED ();
 }
 
+#ifdef VM
+/* Passed from process_fork() to start_fork(). */
+struct fork_info
+  {
+    struct thread *parent;              /* Process being forked. */
+    struct intr_frame if_;              /* Parent's user context. */
+  };
+
+/* Gives the current thread its own handles on PARENT's
+   executable and open files, at the same positions. */
+static bool
+copy_files (struct thread *parent)
+{
+  struct thread *curr = thread_current ();
+  struct list_elem *e;
+
+  curr->file = file_reopen (parent->file);
+  if (curr->file == NULL)
+    return false;
+  file_deny_write (curr->file);
+
+  for (e = list_begin (&parent->file_list); e != list_end (&parent->file_list);
+       e = list_next (e))
+    {
+      struct file_descriptor *pfd
+        = list_entry (e, struct file_descriptor, elem);
+      struct file_descriptor *cfd = malloc (sizeof *cfd);
+
+      if (cfd == NULL)
+        return false;
+      cfd->file = file_reopen (pfd->file);
+      if (cfd->file == NULL)
+        {
+          free (cfd);
+          return false;
+        }
+      file_seek (cfd->file, file_tell (pfd->file));
+      cfd->fd = pfd->fd;
+      list_push_back (&curr->file_list, &cfd->elem);
+    }
+  curr->fd = parent->fd;
+  return true;
+}
+
+/* A thread function that makes the current thread a copy of the
+   forking process and returns to user mode in it. */
+static void
+start_fork (void *info_)
+{
+  struct fork_info *info = info_;
+  struct thread *parent = info->parent;
+  struct thread *curr = thread_current ();
+  struct intr_frame if_ = info->if_;
+  bool success = false;
+
+  curr->pagedir = pagedir_create ();
+  if (curr->pagedir != NULL)
+    {
+      process_activate ();
+      curr->esp = parent->esp;
+      success = copy_files (parent) && page_table_copy (parent);
+    }
+
+  /* INFO and PARENT may go away once the parent is woken. */
+  curr->load_status = success;
+  sema_up (&curr->sema_load);
+  if (!success)
+    thread_exit ();
+
+  /* fork() returns 0 in the child. */
+  if_.eax = 0;
+  asm volatile ("movl %0, %%esp; jmp intr_exit" : : "g" (&if_) : "memory");
+  NOT_REACHED ();
+}
+
+/* Creates a child process that is a copy of the current one,
+   which entered the kernel with user context IF_.  Resident
+   pages are shared copy-on-write rather than copied.  Returns
+   the child's thread id, or TID_ERROR if it could not be
+   created. */
+tid_t
+process_fork (struct intr_frame *if_)
+{
+  struct thread *curr = thread_current ();
+  struct fork_info info;
+  struct thread *child;
+  tid_t tid;
+
+  info.parent = curr;
+  info.if_ = *if_;
+  tid = thread_create (curr->name, PRI_DEFAULT, start_fork, &info);
+  if (tid == TID_ERROR)
+    return TID_ERROR;
+
+  child = get_child_thread (tid);
+  sema_down (&child->sema_load);
+  return child->load_status ? tid : TID_ERROR;
+}
+#else
+tid_t
+process_fork (struct intr_frame *if_ UNUSED)
+{
+  return TID_ERROR;
+}
+#endif
+
 /* Waits for thread TID to die and returns its exit status.  If
    it was terminated by the kernel (i.e. killed due to an
    exception), returns -1.  If TID is invalid or if it was not a
@@ -336,9 +443,7 @@ load (const char *cmd_line, void (**eip) (void), void **esp)
   //printf("pagdir created tid = %d\n", t->tid);
 
   /* Open executable file. */
-  lock_acquire(&lock_filesys);
   file = filesys_open (file_name);
-  lock_release(&lock_filesys);
   if (file == NULL) 
     {
       printf ("load: %s: open failed\n", file_name);
@@ -661,30 +766,17 @@ setup_stack (void **esp)
   struct page_table_entry *pte;
 
   /*프레임을 생성한 후 프레임 리스트에 추가한다*/
-  frame = frame_alloc();
-
-  if(frame == NULL){
-    //printf("setup_stack - swap_out\n");
-    if(swap_out()){
-      frame = frame_alloc();
-    }
-    else{
-      return false;
-    }
-  }
-  frame_to_table(frame, upage);
+  frame = page_frame_alloc();
+  if(frame == NULL)
+    return false;
 
   /*page table entry를 생성한 후 페이지 테이블에 넣어준다*/
   pte = page_table_entry_alloc(upage, frame, true);
   page_table_add(pte);
 
-  success = install_page(upage, frame->kaddr, true);
+  success = stack_install(pte);
   if(success)
     *esp = PHYS_BASE;
-  else
-    /*install_page 함수가 success가 안되면 페이지 테이블에서 제거하고 
-    프레임 테이블에서도 제거해준다*/
-    page_table_delete(pte);
 
   return success;
 
@@ -829,30 +921,38 @@ stack_growth(void *vaddr){
   //printf("stack_growth start\n");
 
   /*프레임을 생성한 후 프레임 리스트에 추가한다*/
-  frame = frame_alloc();
-
-  if(frame == NULL){
-    //printf("stack_growth - frame_alloc failed\n");
-    if(swap_out()){
-      frame = frame_alloc();
-    }
-    else{
-      return false;
-    }
-  }  
-  frame_to_table(frame, upage);
+  frame = page_frame_alloc();
+  if(frame == NULL)
+    return false;
 
   /*page table entry를 생성한 후 페이지 테이블에 넣어준다*/
   pte = page_table_entry_alloc(upage, frame, true);
   page_table_add(pte);
 
-  success = install_page(upage, frame->kaddr, true);
-      
-  if(!success)
-    /*install_page 함수가 success가 안되면 페이지 테이블에서 제거하고 
-    프레임 테이블에서도 제거해준다*/
-    page_table_delete(pte);
+  success = stack_install(pte);
 
   //printf("stack_growth done\n");
   return success;
 }
+
+/* Maps the stack page PTE, which already has its frame, and only
+   then lets the clock see the frame, so that an eviction always
+   finds the PTE.  On failure removes PTE again. */
+static bool
+stack_install (struct page_table_entry *pte)
+{
+  struct thread *curr = thread_current ();
+
+  if (install_page (pte->vaddr, pte->frame->kaddr, true))
+    {
+      frame_to_table (pte->frame, pte->vaddr);
+      return true;
+    }
+
+  /*install_page 함수가 success가 안되면 페이지 테이블에서 제거하고 
+  프레임 테이블에서도 제거해준다*/
+  lock_acquire (&curr->page_table_lock);
+  page_table_delete (pte);
+  lock_release (&curr->page_table_lock);
+  return false;
+}
@@ -45,10 +45,32 @@ unsigned tell(int fd);
 void close(int fd);
 mapid_t mmap(int fd, void *addr);
 void munmap(mapid_t mapping);
+int madvise(void *addr, size_t length, int advice);
 
 struct file *get_file(int fd);
 struct mmap_file *get_mmap_file(int map_id);
 
+/*
+The file system does its own locking, per inode, per directory and
+for the free map, so file syscalls normally run in parallel.  The
+-serialfs kernel option puts them all back under one global lock,
+to compare the two.
+*/
+bool serialize_filesys;
+static struct lock lock_filesys;
+
+static void
+filesys_enter(void){
+	if(serialize_filesys)
+		lock_acquire(&lock_filesys);
+}
+
+static void
+filesys_exit(void){
+	if(serialize_filesys)
+		lock_release(&lock_filesys);
+}
+
 static int 
 get_user (const uint8_t *uaddr)
 {
@@ -230,6 +252,12 @@ syscall_handler (struct intr_frame *f)
 	  	case SYS_MUNMAP:
 	  		munmap((mapid_t)get_argv((int *)f->esp+1));
 	  		break;
+	  	case SYS_FORK:
+	  		f->eax = process_fork(f);
+	  		break;
+	  	case SYS_MADVISE:
+	  		f->eax = madvise((void *)get_argv((int *)f->esp+1), (size_t)get_argv((int *)f->esp+2), (int)get_argv((int *)f->esp+3));
+	  		break;
 	}
 	
 }
@@ -333,9 +361,9 @@ create(const char *file, unsigned initial_size){
 	if(file==NULL)
 		exit(-1);
 
-	lock_acquire(&lock_filesys);
+	filesys_enter();
 	result = filesys_create(file, initial_size);
-	lock_release(&lock_filesys);
+	filesys_exit();
 	//printf("result = %d\n", result);
 
 	return result;
@@ -347,9 +375,9 @@ remove(const char *file){
 	bool result;
 
 	//check_pointer(file);
-	lock_acquire(&lock_filesys);
+	filesys_enter();
 	result = filesys_remove(file);
-	lock_release(&lock_filesys);
+	filesys_exit();
 
 	return result;
 }
@@ -368,9 +396,9 @@ open(const char *file){
 
 	struct thread *curr = thread_current();
 	//check_pointer(file);
-	lock_acquire(&lock_filesys);
+	filesys_enter();
 	struct file *f = filesys_open(file);
-	lock_release(&lock_filesys);
+	filesys_exit();
 	
 	if(!f){
 		result = -1;
@@ -400,7 +428,7 @@ filesize(int fd){
 	//printf("SYS_FILESIZE\n");
 	int result;
 
-	lock_acquire(&lock_filesys);
+	filesys_enter();
 	struct file * file = get_file(fd);
 
 	if(!file){
@@ -409,7 +437,7 @@ filesize(int fd){
 	else{
 		result = file_length(file);
 	}
-	lock_release(&lock_filesys);
+	filesys_exit();
 
 	return result;
 }
@@ -436,7 +464,7 @@ read(int fd, void *buffer, unsigned size){
 
 	}
 	else{
-		lock_acquire(&lock_filesys);
+		filesys_enter();
 		struct file *file = get_file(fd);
 
 		if(!file){
@@ -445,7 +473,7 @@ read(int fd, void *buffer, unsigned size){
 		else{
 			result = file_read(file, buffer, size);
 		}
-		lock_release(&lock_filesys);
+		filesys_exit();
 	}
 
 	//set_accessable_buff(buffer, buffer + size, true);
@@ -472,9 +500,9 @@ write(int fd, const void *buffer, unsigned size){
 			result = 0;
 		}
 		else{
-			lock_acquire(&lock_filesys);
+			filesys_enter();
 			result = file_write(file, buffer, size);
-			lock_release(&lock_filesys);
+			filesys_exit();
 		}
 		//printf("syscall_handler - SYS_WRITE -result = %d\n", result);
 		
@@ -488,14 +516,12 @@ write(int fd, const void *buffer, unsigned size){
 void
 seek(int fd, unsigned position){
 	//printf("SYS_SEEK\n");
-	lock_acquire(&lock_filesys);
+	filesys_enter();
 	struct file * file = get_file(fd);
 
-	if(!file){
-		return -1;
-	}
-	file_seek(file, position);
-	lock_release(&lock_filesys);
+	if(file)
+		file_seek(file, position);
+	filesys_exit();
 }
 
 unsigned
@@ -503,7 +529,7 @@ tell(int fd){
 	//printf("SYS_TELL\n");
 	off_t result;
 
-	lock_acquire(&lock_filesys);
+	filesys_enter();
 	struct file * file = get_file(fd);
 
 	if(!file){
@@ -512,7 +538,7 @@ tell(int fd){
 	else{
 		result = file_tell(file);
 	}
-	lock_release(&lock_filesys);
+	filesys_exit();
 
 	return result;
 }
@@ -536,9 +562,9 @@ close(int fd){
 		if(fd == file_descriptor->fd){
 			list_remove(&file_descriptor->elem);
 
-			lock_acquire(&lock_filesys);
+			filesys_enter();
 			file_close(file_descriptor->file);
-			lock_release(&lock_filesys);
+			filesys_exit();
 			//free(file_descriptor);
 			break;
 		}
@@ -631,15 +657,19 @@ munmap(mapid_t mapping){
 
 	ASSERT(&mmap_file->pte_list != NULL);
 
-	lock_acquire(&lock_filesys);
+	filesys_enter();
+	// with the page table locked no page of ours is evicted, so the
+	// frames can be written back directly
+	lock_acquire(&curr->page_table_lock);
 	for(e = list_begin(&mmap_file->pte_list); e != list_end(&mmap_file->pte_list); ){
 		
 		pte = list_entry(e, struct page_table_entry, mmap_elem);
+		page_wait(pte);
 		//printf("vaddr = %x read_bytes = %d offset = %d\n", pte->vaddr, pte->read_bytes, pte->offset);
 		//printf("pte->loaded = %d dirty = %d\n",pte->loaded, pagedir_is_dirty(curr->pagedir, pte->vaddr));
 		if(pte->loaded && pagedir_is_dirty(curr->pagedir, pte->vaddr)){
 			//printf("vaddr = %x read_bytes = %d offset = %d\n", pte->vaddr, pte->read_bytes, pte->offset);
-			if(file_write_at(pte->file, pte->vaddr, pte->read_bytes, pte->offset)
+			if(file_write_at(pte->file, pte->frame->kaddr, pte->read_bytes, pte->offset)
 					!= (int) pte->read_bytes){
 				printf("munmap - file didn't write\n");
 			}
@@ -650,8 +680,9 @@ munmap(mapid_t mapping){
 		page_table_delete(pte);
 		//printf("pte->vaddr = %p\n", list_entry(e, struct page_table_entry, mmap_elem)->vaddr);
 	}
+	lock_release(&curr->page_table_lock);
 	//printf("lock_released\n");
-	lock_release(&lock_filesys);
+	filesys_exit();
 	//printf("pte processing done\n");
 
 	list_remove(&mmap_file->elem);
@@ -659,3 +690,48 @@ munmap(mapid_t mapping){
 	free(mmap_file);
 	//printf("free(mmap_file)\n");
 }
+
+/*
+Applies ADVICE to the LENGTH bytes at ADDR, which must be page
+aligned and lie entirely in mmap regions.  MADV_NORMAL, MADV_RANDOM
+and MADV_SEQUENTIAL are remembered per page and steer fault-around
+and drop-behind; MADV_WILLNEED reads the pages in now and
+MADV_DONTNEED writes back and drops them now.  Returns 0, or -1 if
+the arguments are bad.
+*/
+int
+madvise(void *addr, size_t length, int advice){
+	struct thread *curr = thread_current();
+	struct page_table_entry *pte;
+	uint8_t *start = addr, *end = start + length, *vaddr;
+
+	if(addr != pg_round_down(addr) || length == 0 || end < start)
+		return -1;
+	if(advice < MADV_NORMAL || advice > MADV_DONTNEED)
+		return -1;
+
+	lock_acquire(&curr->page_table_lock);
+	for(vaddr = start; vaddr < end; vaddr += PGSIZE){
+		pte = page_table_find(vaddr, curr);
+		if(pte == NULL || pte->type != PTE_MMAP){
+			lock_release(&curr->page_table_lock);
+			return -1;
+		}
+	}
+	for(vaddr = start; vaddr < end && advice != MADV_WILLNEED; vaddr += PGSIZE){
+		pte = page_table_find(vaddr, curr);
+		if(advice == MADV_DONTNEED)
+			page_drop(pte);
+		else
+			pte->advice = advice;
+	}
+	lock_release(&curr->page_table_lock);
+
+	// only we change our page table, so the pages are still there
+	if(advice == MADV_WILLNEED)
+		for(vaddr = start; vaddr < end; vaddr += PGSIZE)
+			if(!page_load(page_table_find(vaddr, curr)))
+				break;
+
+	return 0;
+}
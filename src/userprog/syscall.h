@@ -1,6 +1,7 @@
 #ifndef USERPROG_SYSCALL_H
 #define USERPROG_SYSCALL_H
 
+#include <stdbool.h>
 #include "lib/kernel/list.h"
 
 void syscall_init (void);
@@ -19,6 +20,6 @@ struct mmap_file{
 
 };
 
-struct lock lock_filesys;
+extern bool serialize_filesys;
 
 #endif /* userprog/syscall.h */
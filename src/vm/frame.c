@@ -1,44 +1,67 @@
 #include <stdio.h>
+#include <round.h>
 #include "vm/frame.h"
 #include "threads/palloc.h"
-#include "threads/malloc.h"
 #include "threads/vaddr.h"
 #include "userprog/pagedir.h"
 #include "vm/page.h"
+#include "vm/pageout.h"
 
+static uint8_t *frame_base;
+
+// frames handed out by frame_alloc and not yet freed
+static size_t frame_alloc_cnt;
+
+// clock hand, kept across evictions
+static size_t clock_hand;
+bool clock_enhanced = false;
+
+// eviction statistics
+static long long evict_cnt;
+static long long scan_cnt;
+static long long max_scan_cnt;
+static long long busy_cnt;			// victims skipped because their owner was busy
+
+static struct frame *
+frame_of(void *kaddr){
+	size_t idx = ((uint8_t *) kaddr - frame_base) / PGSIZE;
+	ASSERT(idx < frame_table_size);
+	return &frame_table[idx];
+}
 
 void
 frame_table_init(){
-	list_init(&frame_table);
+	size_t i;
+
+	frame_base = palloc_user_base();
+	frame_table_size = palloc_user_page_cnt();
+	frame_used_cnt = 0;
+	frame_table = palloc_get_multiple(PAL_ASSERT | PAL_ZERO,
+			DIV_ROUND_UP(frame_table_size * sizeof(struct frame), PGSIZE));
+	for(i = 0; i < frame_table_size; i++){
+		frame_table[i].kaddr = frame_base + i * PGSIZE;
+		list_init(&frame_table[i].cow_ptes);
+	}
 	lock_init(&lock_frame);
 }
 
 struct frame *
 frame_alloc(){
-
-	//lock_acquire(&lock_frame);
-
 	void *kpage = palloc_get_page(PAL_USER);
 	if(kpage == NULL){
 		//printf("frame_alloc - palloc failed\n");
 		return NULL;
 	}
-	struct frame *f = malloc(sizeof(struct frame));
-
-	if(f== NULL){
-		printf("frame_alloc - malloc failed\n");
-		palloc_free_page(kpage);
-		return NULL;
-	}
+	struct frame *f = frame_of(kpage);
 
-	f->kaddr = kpage;
-	//f->accessable = false;
+	ASSERT(!f->used);
 	f->thread = thread_current();
 
-	//printf("frame_alloc - &thread_current()->tid = %d\n", &thread_current()->tid);
-
-	//lock_release(&lock_frame);
-	//printf("frame_alloced\n");
+	lock_acquire(&lock_frame);
+	frame_alloc_cnt++;
+	lock_release(&lock_frame);
+	if(frame_free_cnt() < pageout_low)
+		pageout_wake();
 
 	return f;
 }
@@ -55,7 +78,9 @@ frame_set_vaddr(struct frame * frame, void *vaddr){
 
 void
 frame_add(struct frame *frame){
-	list_push_back(&frame_table, &frame->elem);
+	ASSERT(!frame->used);
+	frame->used = true;
+	frame_used_cnt++;
 }
 
 void
@@ -69,132 +94,153 @@ frame_to_table(struct frame *frame, void *vaddr){
 
 void
 frame_free(struct frame *frame){
-	//lock_acquire(&lock_frame);
-	//printf("frame_free frame kaddr = %x\n", frame->kaddr);
-	list_remove(&frame->elem);
-	//printf("frame_free - list removed\n");
+	lock_acquire(&lock_frame);
+	if(frame->used){
+		frame->used = false;
+		frame_used_cnt--;
+	}
+	frame_alloc_cnt--;
+	lock_release(&lock_frame);
 	palloc_free_page(frame->kaddr);
-	//printf("frame_free - palloc_free_page\n");
-	free(frame);
-	//printf("frame_free - free(frame)\n");
-	//lock_release(&lock_frame);
+}
+
+// number of user frames frame_alloc can still hand out without evicting
+size_t
+frame_free_cnt(void){
+	return frame_table_size - frame_alloc_cnt;
 }
 
 struct frame *
 frame_find(void *kaddr){
-	ASSERT(!list_empty(&frame_table));
-
-	lock_acquire(&lock_frame);
-
-	struct list_elem *e;
 	struct frame *f;
 
-	for(e=list_begin(&frame_table); e!=list_end(&frame_table); e=list_next(e)){
-		f = list_entry(e, struct frame, elem);
-		if(f->kaddr == kaddr){
-			lock_release(&lock_frame);
-			return f;
-		}
-	}
+	if((uint8_t *) kaddr < frame_base
+		|| (uint8_t *) kaddr >= frame_base + frame_table_size * PGSIZE)
+		return NULL;
 
-	lock_release(&lock_frame);
-	return NULL;
+	f = frame_of(pg_round_down(kaddr));
+	return f->used ? f : NULL;
 }
 
-struct frame *
-frame_replacement_select(){
-	ASSERT(!list_empty(&frame_table));
-
-	//printf("frame_replacement_select\n");
+/* Returns true if F holds a user page that may be evicted. */
+static bool
+frame_candidate(struct frame *f){
+	return f->used && f->accessable && f->thread->pagedir != NULL;
+}
 
-	struct list_elem *e = list_begin(&frame_table);
-	struct frame *f;
+/* Locks the page table of F's owner for eviction and returns true,
+   unless the owner is busy with its page table or the page is
+   already on its way in or out.  Called with lock_frame held, so
+   this must not wait: the owner may be waiting for lock_frame. */
+static bool
+frame_claim(struct frame *f){
+	struct lock *l = &f->thread->page_table_lock;
 	struct page_table_entry *pte;
 
-	while(true){
-		f = list_entry(e, struct frame, elem);
-		pte = page_table_find(f->vaddr, thread_current());
-
-		//printf("f->thread->tid = %d\n", f->thread->tid);
-		//printf("f->addr %x\n", f->addr);
-		
-		if(f->thread->pagedir != NULL){
-			//printf("access bit = %d dirty bit %d\n", 
-			//			pagedir_is_accessed(f->thread->pagedir, f->vaddr), 
-			//			pagedir_is_dirty(f->thread->pagedir, f->vaddr));
-
-
-			if(pagedir_is_accessed(f->thread->pagedir, f->vaddr)){
+	if(lock_held_by_current_thread(l) || !lock_try_acquire(l)){
+		busy_cnt++;
+		return false;
+	}
+	pte = page_table_find(f->vaddr, f->thread);
+	if(pte == NULL || pte->in_transit){
+		lock_release(l);
+		busy_cnt++;
+		return false;
+	}
+	return true;
+}
 
-				pagedir_set_accessed(f->thread->pagedir, f->vaddr, false);
-			}
-			else if(f->accessable == true)
-				//printf("kaddr = %p frame->vaddr = %p pte->vaddr = %p\n", f->kaddr, f->vaddr, pte->vaddr);
-				return f;
-		}
+/* Advances the clock hand and returns the frame it passed. */
+static struct frame *
+clock_advance(void){
+	struct frame *f = &frame_table[clock_hand];
+	clock_hand = (clock_hand + 1) % frame_table_size;
+	scan_cnt++;
+	return f;
+}
 
-		if(e == list_end(&frame_table)){
-			e = list_begin(&frame_table);
-		}
-		else{
-			e = list_next(e);
-		}	
+/* Second chance: the first candidate under the hand whose accessed
+   bit is clear is the victim.  Accessed bits are cleared as the
+   hand passes, so if there is any candidate this ends within two
+   revolutions. */
+static struct frame *
+clock_select(void){
+	struct frame *f;
+	size_t i;
+
+	for(i = 0; i < 2 * frame_table_size; i++){
+		f = clock_advance();
+		if(!frame_candidate(f))
+			continue;
+		if(pagedir_is_accessed(f->thread->pagedir, f->vaddr))
+			pagedir_set_accessed(f->thread->pagedir, f->vaddr, false);
+		else if(frame_claim(f))
+			return f;
 	}
+	return NULL;
 }
 
-struct frame *
-frame_replacement_select_not_current(){
-	struct list_elem *e;
+/* Enhanced clock: prefers pages that are neither accessed nor
+   dirty, since they need no write to evict.  The first revolution
+   only looks for such a page; the second accepts a dirty one and
+   clears accessed bits as it goes.  If there is any candidate the
+   second round of the two finds it. */
+static struct frame *
+clock_select_clean(void){
 	struct frame *f;
-
-	for(e=list_begin(&frame_table); e!=list_end(&frame_table); e=list_next(e)){
-    	f = list_entry(e, struct frame, elem);
-    	//printf("f->thread->tid = %d ", f->thread->tid);
-
-    	if(f->thread->pagedir != NULL){
-    		if(pagedir_is_accessed(f->thread->pagedir, f->vaddr)){
-
-				pagedir_set_accessed(f->thread->pagedir, f->vaddr, false);
-			}
-			else if(f->accessable == true)
-				//lock_release(&lock_frame);
+	uint32_t *pd;
+	size_t i;
+	int round;
+
+	for(round = 0; round < 2; round++){
+		for(i = 0; i < frame_table_size; i++){
+			f = clock_advance();
+			if(!frame_candidate(f))
+				continue;
+			pd = f->thread->pagedir;
+			if(!pagedir_is_accessed(pd, f->vaddr) && !pagedir_is_dirty(pd, f->vaddr)
+					&& frame_claim(f))
 				return f;
 		}
+		for(i = 0; i < frame_table_size; i++){
+			f = clock_advance();
+			if(!frame_candidate(f))
+				continue;
+			pd = f->thread->pagedir;
+			if(!pagedir_is_accessed(pd, f->vaddr)){
+				if(frame_claim(f))
+					return f;
+			}
+			else
+				pagedir_set_accessed(pd, f->vaddr, false);
+		}
 	}
-
 	return NULL;
 }
 
+/* Picks a frame to evict and returns it with its owner's
+   page_table_lock held, or returns NULL if there is none. */
 struct frame *
-frame_replacement_select_current(){
-	struct list_elem *e;
+frame_replacement_select(){
 	struct frame *f;
+	long long start;
 
-	for(e=list_begin(&frame_table); e!=list_end(&frame_table); e=list_next(e)){
-    	f = list_entry(e, struct frame, elem);
-    	//printf("f->thread->tid = %d ", f->thread->tid);
-
-    	if(f->thread->pagedir != NULL){
-    		if(pagedir_is_accessed(f->thread->pagedir, f->vaddr)){
-
-				pagedir_set_accessed(f->thread->pagedir, f->vaddr, false);
-			}
-			else if(f->accessable == true)
-				//lock_release(&lock_frame);
-				return f;
-		}
-	}
+	lock_acquire(&lock_frame);
+	start = scan_cnt;
+	f = clock_enhanced ? clock_select_clean() : clock_select();
+	if(f != NULL)
+		evict_cnt++;
+	if(scan_cnt - start > max_scan_cnt)
+		max_scan_cnt = scan_cnt - start;
+	lock_release(&lock_frame);
 
-	return NULL;
+	return f;
 }
 
-struct frame *
-frame_replacement_select2(){
-	struct frame *f;
-	while(true){
-		f= frame_replacement_select_not_current();
-		if(f != NULL) return f;
-		f = frame_replacement_select_current();
-		if(f !=  NULL) return f;
-	}
+void
+frame_print_stats(void){
+	printf("Frames: %lld evictions, %lld frames scanned, "
+			"%lld scanned at most, %lld busy skipped (%s clock)\n",
+			evict_cnt, scan_cnt, max_scan_cnt, busy_cnt,
+			clock_enhanced ? "enhanced" : "second-chance");
 }
@@ -1,35 +1,43 @@
 #ifndef VM_FRAME_H
 #define VM_FRAME_H
 
+#include <stddef.h>
 #include <list.h>
 #include "threads/synch.h"
 #include "threads/thread.h"
 
 
 struct frame{
-	struct list_elem elem;
+	bool used;
 	void *kaddr;
 	void *vaddr;
 	bool accessable;
 	char *filename;
 
 	struct thread *thread;
+	struct list cow_ptes;		// PTEs sharing the frame copy-on-write, if 2 or more
+	struct list_elem writeback_elem;	// on swap.c's writeback_list
 };
 
-struct list frame_table;
+// one entry per user pool page, indexed by (kaddr - base) / PGSIZE
+struct frame *frame_table;
+size_t frame_table_size;
+size_t frame_used_cnt;
 
 struct lock lock_frame;
 
+// -clock2: evict with the enhanced clock, preferring clean pages
+extern bool clock_enhanced;
+
 void frame_table_init();
 struct frame *frame_alloc();
 void frame_set_accessable(struct frame *frame, bool boolean);
 void frame_set_vaddr(struct frame *frame, void *vaddr);
 void frame_add(struct frame *frame);
 void frame_free(struct frame *frame);
+size_t frame_free_cnt(void);
 void frame_to_table(struct frame *frame, void *vaddr);
 struct frame *frame_find(void *addr);
 struct frame *frame_replacement_select();
-struct frame *frame_replacement_select_current();
-struct frame *frame_replacement_select_not_current();
-struct frame *frame_replacement_select2();
+void frame_print_stats(void);
 #endif 
\ No newline at end of file
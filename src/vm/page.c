@@ -1,10 +1,45 @@
 #include "vm/page.h"
 #include <stdio.h>
+#include <string.h>
 #include "userprog/pagedir.h"
 #include "threads/thread.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
 #include "threads/vaddr.h"
+#include <syscall-nr.h>
 #include "vm/swap.h"
+#include "vm/share.h"
+#include "filesys/file.h"
+
+/*
+Each process's page table is protected by its page_table_lock.  A
+fault or an eviction marks the PTE it works on in_transit and then
+drops the lock for the slow part, the frame allocation and the I/O,
+so faults of different processes, and faults on different pages of
+one process and evictions, run in parallel.  Anyone else who finds
+a PTE in transit waits for it with page_wait().
+
+An evictor only ever try-locks the page table of the frame's owner
+(see frame.c), and nobody waits for another page table's lock while
+holding its own, except fork, which holds the parent's and then the
+child's while neither can fault.
+*/
+
+// attempts to get a frame while other processes keep taking the
+// frames we evict for us
+#define FRAME_ALLOC_TRIES 64
+
+// fork statistics
+static long long cow_share_cnt;		// pages shared at fork
+static long long cow_copy_cnt;		// pages copied on the first write
+static long long fork_copy_cnt;		// swapped-out pages copied at fork
+static long long cow_evict_cnt;		// mappings of shared pages evicted
+
+// madvise statistics
+static long long drop_cnt;			// mmap pages dropped before eviction
+static long long drop_writeback_cnt;	// ... that were written back first
+
+static bool page_cow_release(struct page_table_entry *pte);
 
 
 static unsigned
@@ -32,7 +67,9 @@ page_hash_destroy_func(struct hash_elem *e, void *aux UNUSED){
 
 	struct page_table_entry *pte = hash_entry(e, struct page_table_entry, elem);
 	
-	if(pte->frame != NULL)
+	if(pte->share != NULL)
+		share_release(pte);
+	else if(pte->frame != NULL && !page_cow_release(pte))
 		frame_free(pte->frame);
 
 	if(pte->swap_table_index != -1){
@@ -51,8 +88,17 @@ page_table_init(struct hash *pt){
 
 void
 page_table_destroy(struct hash *pt){
+	struct thread *curr = thread_current();
+	struct hash_iterator i;
+
 	ASSERT(pt != NULL);
+	lock_acquire(&curr->page_table_lock);
+	// evictions of our pages must finish before the frames go away
+	hash_first(&i, pt);
+	while(hash_next(&i))
+		page_wait(hash_entry(hash_cur(&i), struct page_table_entry, elem));
 	hash_destroy(pt, page_hash_destroy_func);
+	lock_release(&curr->page_table_lock);
 }
 
 struct page_table_entry *
@@ -69,12 +115,18 @@ page_table_entry_alloc(void *vaddr, struct frame *frame, bool writable){
 	pte->writable = writable;
 	pte->accessable = true;
 	pte->loaded = false;
+	pte->in_transit = false;
+	pte->advice = MADV_NORMAL;
 
 	pte->file = NULL;
 	pte->offset = -1;
 	pte->read_bytes = -1;
 	pte->zero_bytes = -1;
 
+	pte->thread = thread_current();
+	pte->share = NULL;
+	pte->cow = false;
+
 	return pte;
 }
 
@@ -93,12 +145,18 @@ page_table_entry_file(void *vaddr, struct file *file, int offset,
 	pte->writable = writable;
 	pte->accessable = true;
 	pte->loaded = false;
+	pte->in_transit = false;
+	pte->advice = MADV_NORMAL;
 
 	pte->file = file;
 	pte->offset = offset;
 	pte->read_bytes = read_bytes;
 	pte->zero_bytes = zero_bytes;
 
+	pte->thread = thread_current();
+	pte->share = NULL;
+	pte->cow = false;
+
 	return pte;
 }
 
@@ -118,12 +176,18 @@ page_table_entry_mmap(void *vaddr, struct file *file, int offset,
 	pte->writable = writable;
 	pte->accessable = true;
 	pte->loaded = false;
+	pte->in_transit = false;
+	pte->advice = MADV_NORMAL;
 	
 	pte->file = file;
 	pte->offset = offset;
 	pte->read_bytes = read_bytes;
 	pte->zero_bytes = zero_bytes;
 
+	pte->thread = thread_current();
+	pte->share = NULL;
+	pte->cow = false;
+
 	return pte;
 }
 
@@ -134,16 +198,25 @@ page_table_add(struct page_table_entry *pte){
 
 	//printf("page_table_added\n");
 
+	lock_acquire(&thread_current()->page_table_lock);
 	hash_insert(&thread_current()->page_table, &pte->elem);
+	lock_release(&thread_current()->page_table_lock);
 }
 
+/*
+Removes PTE from the current thread's page table and frees its frame
+or swap slot.  Called with the page_table_lock held.
+*/
 void
 page_table_delete(struct page_table_entry *pte){
 	//printf("page_table_delete - pte->vaddr = %p kaddr = %p thread_current = %d\n", pte->vaddr,pte->frame->kaddr, thread_current()->tid);
-	ASSERT(&thread_current()->page_table != NULL);
+	ASSERT(lock_held_by_current_thread(&thread_current()->page_table_lock));
 
+	page_wait(pte);
 	hash_delete(&thread_current()->page_table, &pte->elem);
-	if(pte->frame != NULL){
+	if(pte->share != NULL)
+		share_release(pte);
+	else if(pte->frame != NULL && !page_cow_release(pte)){
 		//printf("page_table_delete - frame is not null\n");
 		frame_free(pte->frame);
 	}
@@ -179,6 +252,410 @@ page_table_find(void *uaddr, struct thread *t){
 	return hash_entry(e, struct page_table_entry, elem);
 }
 
+/*
+Waits until PTE is not being loaded or evicted.  Called with the
+page_table_lock of PTE's owner held, which is released meanwhile.
+*/
+void
+page_wait(struct page_table_entry *pte){
+	struct thread *t = pte->thread;
+
+	ASSERT(lock_held_by_current_thread(&t->page_table_lock));
+	while(pte->in_transit)
+		cond_wait(&t->page_transit, &t->page_table_lock);
+}
+
+/*
+Copy-on-write.  At fork every resident page of the parent is shared
+with the child: both map the frame read-only and both PTEs go on the
+frame's cow_ptes list.  The first write to a shared page copies it;
+once only one mapping is left it is simply made writable again.
+A frame on a cow_ptes list is evicted from all its mappings at once
+by page_cow_evict().  lock_frame protects the lists.
+*/
+
+// takes PTE off its frame's cow_ptes; the last remaining mapping
+// becomes the frame's owner.  called with lock_frame held
+static void
+cow_unlink(struct page_table_entry *pte){
+	struct frame *f = pte->frame;
+	struct page_table_entry *last;
+
+	list_remove(&pte->cow_elem);
+	if(list_size(&f->cow_ptes) == 1){
+		last = list_entry(list_pop_front(&f->cow_ptes), struct page_table_entry, cow_elem);
+		f->thread = last->thread;
+		f->vaddr = last->vaddr;
+	}
+}
+
+// drops PTE's share of a copy-on-write frame.  returns false if
+// PTE was its only mapping, in which case the caller frees it
+static bool
+page_cow_release(struct page_table_entry *pte){
+	bool shared;
+
+	lock_acquire(&lock_frame);
+	shared = !list_empty(&pte->frame->cow_ptes);
+	if(shared)
+		cow_unlink(pte);
+	lock_release(&lock_frame);
+
+	return shared;
+}
+
+// returns true if a mapping of F before E belongs to thread T
+static bool
+cow_seen(struct frame *f, struct list_elem *e, struct thread *t){
+	struct list_elem *i;
+
+	for(i = list_begin(&f->cow_ptes); i != e; i = list_next(i))
+		if(list_entry(i, struct page_table_entry, cow_elem)->thread == t)
+			return true;
+	return false;
+}
+
+// returns true if page_cow_evict must lock the owner of the mapping E
+// of F, that is, if it is not OWNER and has not been locked already
+static bool
+cow_must_lock(struct frame *f, struct thread *owner, struct list_elem *e){
+	struct thread *t = list_entry(e, struct page_table_entry, cow_elem)->thread;
+
+	return t != owner && !cow_seen(f, e, t);
+}
+
+// releases the page table locks page_cow_evict took for the mappings
+// of F before STOP
+static void
+cow_unlock(struct frame *f, struct thread *owner, struct list_elem *stop){
+	struct list_elem *e;
+
+	for(e = list_begin(&f->cow_ptes); e != stop; e = list_next(e))
+		if(cow_must_lock(f, owner, e))
+			lock_release(&list_entry(e, struct page_table_entry, cow_elem)
+					->thread->page_table_lock);
+}
+
+// unmaps P from frame F, to swap unless it is a clean file page.
+// returns false if swap is full
+static bool
+cow_evict_one(struct frame *f, struct page_table_entry *p){
+	uint32_t *pd = p->thread->pagedir;
+	int swap_table_index;
+
+	pagedir_clear_page(pd, p->vaddr);
+	if(p->type == PTE_FILE && !pagedir_is_dirty(pd, p->vaddr))
+		p->loaded = false;
+	else{
+		swap_table_index = swap_add(f->kaddr);
+		if(swap_table_index == -2){
+			pagedir_set_page(pd, p->vaddr, f->kaddr, false);
+			return false;
+		}
+		p->type = PTE_FRAME;
+		p->swap_table_index = swap_table_index;
+	}
+	p->frame = NULL;
+	p->cow = false;
+	cow_evict_cnt++;
+	return true;
+}
+
+/*
+Evicts F, which is shared copy-on-write, from every process mapping
+it and frees it.  Swap slots are not shared, so each mapping gets a
+copy of its own.  The caller holds the page_table_lock of F's owner;
+those of the other mappings' owners are only tried, as frame_claim
+does, and if one is busy or its page in transit nothing is evicted.
+Holding them all keeps the cow_ptes list from changing meanwhile.
+Returns false if F was not evicted; if swap fills up halfway, the
+mappings not evicted yet keep it.
+*/
+bool
+page_cow_evict(struct frame *f){
+	struct thread *owner = f->thread;
+	struct page_table_entry *p;
+	struct list_elem *e;
+	struct lock *l;
+	bool busy = false;
+	int evicted = 0;
+
+	lock_acquire(&lock_frame);
+	if(list_empty(&f->cow_ptes)){
+		lock_release(&lock_frame);
+		return false;
+	}
+	for(e = list_begin(&f->cow_ptes); e != list_end(&f->cow_ptes); e = list_next(e)){
+		p = list_entry(e, struct page_table_entry, cow_elem);
+		l = &p->thread->page_table_lock;
+		if(cow_must_lock(f, owner, e)
+				&& (lock_held_by_current_thread(l) || !lock_try_acquire(l))){
+			busy = true;
+			break;
+		}
+		if(p->in_transit){
+			busy = true;
+			e = list_next(e);
+			break;
+		}
+	}
+	if(busy){
+		cow_unlock(f, owner, e);
+		lock_release(&lock_frame);
+		return false;
+	}
+	lock_release(&lock_frame);
+
+	for(e = list_begin(&f->cow_ptes); e != list_end(&f->cow_ptes); e = list_next(e)){
+		if(!cow_evict_one(f, list_entry(e, struct page_table_entry, cow_elem)))
+			break;
+		evicted++;
+	}
+
+	lock_acquire(&lock_frame);
+	cow_unlock(f, owner, list_end(&f->cow_ptes));
+	if(e == list_end(&f->cow_ptes))
+		list_init(&f->cow_ptes);
+	else
+		while(evicted-- > 0){
+			p = list_entry(list_front(&f->cow_ptes), struct page_table_entry, cow_elem);
+			p->frame = f;
+			cow_unlink(p);
+			p->frame = NULL;
+		}
+	lock_release(&lock_frame);
+
+	if(e != list_end(&f->cow_ptes))
+		return false;
+	frame_free(f);
+	return true;
+}
+
+/*
+Allocates a frame, evicting pages for it if none is free.  Another
+process may take the frame we freed before we get to it, and every
+candidate may be busy for a moment, so keep at it for a while.
+*/
+struct frame *
+page_frame_alloc(void){
+	struct frame *frame;
+	int tries = 0;
+
+	while((frame = frame_alloc()) == NULL){
+		if(++tries > FRAME_ALLOC_TRIES)
+			return NULL;
+		if(!swap_out())
+			thread_yield();
+	}
+	return frame;
+}
+
+// copies the parent's PTE P into a new PTE of the current thread
+static bool
+page_copy(struct thread *parent, struct page_table_entry *p){
+	struct thread *curr = thread_current();
+	struct page_table_entry *c;
+	struct frame *frame;
+
+	c = malloc(sizeof *c);
+	if(c == NULL)
+		return false;
+	*c = *p;
+	c->thread = curr;
+	c->frame = NULL;
+	c->swap_table_index = -1;
+	c->share = NULL;
+	c->cow = false;
+	if(c->type == PTE_FILE)
+		c->file = curr->file;
+
+	if(p->share != NULL){
+		// shared executable page; the child finds it on its first fault
+		c->loaded = false;
+	}
+	else if(p->frame != NULL){
+		// a file page written in memory must not be dropped by the
+		// child, whose PTE starts out clean
+		if(p->type == PTE_FILE && pagedir_is_dirty(parent->pagedir, p->vaddr))
+			p->type = c->type = PTE_FRAME;
+
+		lock_acquire(&lock_frame);
+		if(list_empty(&p->frame->cow_ptes))
+			list_push_back(&p->frame->cow_ptes, &p->cow_elem);
+		list_push_back(&p->frame->cow_ptes, &c->cow_elem);
+		lock_release(&lock_frame);
+
+		if(p->writable){
+			pagedir_set_writable(parent->pagedir, p->vaddr, false);
+			p->cow = c->cow = true;
+		}
+		c->frame = p->frame;
+		if(!pagedir_set_page(curr->pagedir, c->vaddr, c->frame->kaddr, false)){
+			page_cow_release(c);
+			free(c);
+			return false;
+		}
+		cow_share_cnt++;
+	}
+	else if(p->swap_table_index != -1){
+		frame = page_frame_alloc();
+		if(frame == NULL){
+			free(c);
+			return false;
+		}
+		swap_read(frame->kaddr, p->swap_table_index);
+		if(!pagedir_set_page(curr->pagedir, c->vaddr, frame->kaddr, c->writable)){
+			frame_free(frame);
+			free(c);
+			return false;
+		}
+		c->frame = frame;
+		hash_insert(&curr->page_table, &c->elem);
+		frame_to_table(frame, c->vaddr);
+		fork_copy_cnt++;
+		return true;
+	}
+
+	hash_insert(&curr->page_table, &c->elem);
+	return true;
+}
+
+/*
+Copies PARENT's page table into the current thread's, which must be
+empty, sharing resident pages copy-on-write.  mmap regions are not
+inherited.  PARENT must not run meanwhile.  Both page tables stay
+locked, so that neither can lose pages to eviction halfway.
+*/
+bool
+page_table_copy(struct thread *parent){
+	struct thread *curr = thread_current();
+	struct hash_iterator i;
+	struct page_table_entry *p;
+	bool success = true;
+
+	lock_acquire(&parent->page_table_lock);
+	lock_acquire(&curr->page_table_lock);
+	hash_first(&i, &parent->page_table);
+	while(success && hash_next(&i)){
+		p = hash_entry(hash_cur(&i), struct page_table_entry, elem);
+		if(p->type == PTE_MMAP)
+			continue;
+		page_wait(p);
+		success = page_copy(parent, p);
+	}
+	lock_release(&curr->page_table_lock);
+	lock_release(&parent->page_table_lock);
+	return success;
+}
+
+/*
+Handles a write to a present, read-only page at FAULT_ADDR.  Returns
+false if the page is not copy-on-write, in which case the write is
+a real protection violation.  If the page was evicted since the
+fault, returns true so that the write faults it back in.
+*/
+bool
+page_cow_fault(void *fault_addr){
+	struct thread *curr = thread_current();
+	struct page_table_entry *pte;
+	struct frame *old, *new;
+
+	lock_acquire(&curr->page_table_lock);
+	pte = page_table_find(fault_addr, curr);
+	if(pte != NULL)
+		page_wait(pte);
+	if(pte == NULL || !pte->cow || pte->frame == NULL){
+		lock_release(&curr->page_table_lock);
+		return pte != NULL && pagedir_get_page(curr->pagedir, pte->vaddr) == NULL;
+	}
+	pte->in_transit = true;
+	lock_release(&curr->page_table_lock);
+
+	old = pte->frame;
+	new = NULL;
+	if(!list_empty(&old->cow_ptes)){
+		new = page_frame_alloc();
+		if(new == NULL){
+			lock_acquire(&curr->page_table_lock);
+			pte->in_transit = false;
+			cond_broadcast(&curr->page_transit, &curr->page_table_lock);
+			lock_release(&curr->page_table_lock);
+			return false;
+		}
+		memcpy(new->kaddr, old->kaddr, PGSIZE);
+	}
+
+	lock_acquire(&lock_frame);
+	if(new != NULL && list_empty(&old->cow_ptes)){
+		// the other mappings went away while we copied
+		lock_release(&lock_frame);
+		frame_free(new);
+		new = NULL;
+	}
+	else{
+		if(new != NULL)
+			cow_unlink(pte);
+		lock_release(&lock_frame);
+	}
+
+	lock_acquire(&curr->page_table_lock);
+	if(new == NULL)
+		pagedir_set_writable(curr->pagedir, pte->vaddr, true);
+	else{
+		pagedir_clear_page(curr->pagedir, pte->vaddr);
+		pagedir_set_page(curr->pagedir, pte->vaddr, new->kaddr, true);
+		pte->frame = new;
+		frame_to_table(new, pte->vaddr);
+		cow_copy_cnt++;
+	}
+	pte->cow = false;
+	pte->in_transit = false;
+	cond_broadcast(&curr->page_transit, &curr->page_table_lock);
+	lock_release(&curr->page_table_lock);
+
+	return true;
+}
+
+/*
+Drops the mmap page PTE from memory ahead of eviction, writing it
+back to its file first if it is dirty, and frees its frame.  The next
+access reads it from the file again.  Called with the page_table_lock
+held.
+*/
+void
+page_drop(struct page_table_entry *pte){
+	struct thread *curr = thread_current();
+
+	ASSERT(lock_held_by_current_thread(&curr->page_table_lock));
+	ASSERT(pte->type == PTE_MMAP);
+
+	page_wait(pte);
+	if(!pte->loaded || pte->frame == NULL)
+		return;
+
+	// the dirty bit survives in the not-present PTE
+	pagedir_clear_page(curr->pagedir, pte->vaddr);
+	if(pagedir_is_dirty(curr->pagedir, pte->vaddr)){
+		if(file_write_at(pte->file, pte->frame->kaddr, pte->read_bytes, pte->offset)
+				!= (int) pte->read_bytes)
+			printf("page_drop - mmap didn't write\n");
+		drop_writeback_cnt++;
+	}
+	frame_free(pte->frame);
+	pte->frame = NULL;
+	pte->loaded = false;
+	drop_cnt++;
+}
+
+void
+page_print_stats(void){
+	printf("Fork: %lld pages shared copy-on-write, %lld copied on write, "
+			"%lld copied from swap, %lld shared mappings evicted\n",
+			cow_share_cnt, cow_copy_cnt, fork_copy_cnt, cow_evict_cnt);
+	printf("Madvise: %lld mmap pages dropped early, %lld of them written back\n",
+			drop_cnt, drop_writeback_cnt);
+}
+
 /*
 bool
 file_load(struct page_table_entry *pte){
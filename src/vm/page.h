@@ -19,12 +19,20 @@ struct page_table_entry{
 	bool writable;
 	bool accessable;
 	bool loaded;
+	bool in_transit;				// being loaded or evicted; see page_wait()
+	int advice;						// MADV_* given for an mmap page
 	
 	struct file *file;
 	int offset;
 	int read_bytes;
 	int zero_bytes;
 
+	struct thread *thread;			// owner
+	struct share_entry *share;		// shared executable page, or NULL
+	struct list_elem share_elem;
+	bool cow;						// mapped read-only until the first write
+	struct list_elem cow_elem;		// frame's cow_ptes
+
 	struct hash_elem elem;
 	struct list_elem mmap_elem;
 };
@@ -41,5 +49,12 @@ struct page_table_entry *page_table_entry_mmap(void *vaddr, struct file *file, i
 void page_table_add(struct page_table_entry *pte);
 void page_table_delete(struct page_table_entry *pte);
 struct page_table_entry *page_table_find(void *uaddr, struct thread *t);
+void page_wait(struct page_table_entry *pte);
+struct frame *page_frame_alloc(void);
+bool page_table_copy(struct thread *parent);
+bool page_cow_fault(void *fault_addr);
+bool page_cow_evict(struct frame *f);
+void page_drop(struct page_table_entry *pte);
+void page_print_stats(void);
 //bool file_load(struct page_table_entry *pte);
 #endif
\ No newline at end of file
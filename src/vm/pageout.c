@@ -0,0 +1,74 @@
+#include <stdio.h>
+#include "vm/pageout.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "vm/frame.h"
+#include "vm/swap.h"
+
+/*
+Page-out daemon.  frame_alloc wakes it when fewer than pageout_low
+user frames are free, and it evicts in batches of up to
+SWAP_BATCH_MAX frames until pageout_high are free, so that most page
+faults find a free frame without evicting one themselves.  It also
+writes back the dirty mmap pages swap_out hands it.  A low watermark
+of 0 turns off the background eviction but not the write-backs.
+*/
+size_t pageout_low = 16;
+size_t pageout_high = 48;
+
+static struct semaphore pageout_sema;
+static bool pageout_waking;			// pageout_sema up'd but not yet downed
+
+// statistics
+static long long wake_cnt;
+static long long batch_cnt;
+static long long pageout_cnt;
+
+static void pageout_daemon(void *aux);
+
+void
+pageout_init(void){
+	sema_init(&pageout_sema, 0);
+	if(pageout_high > frame_table_size / 2)
+		pageout_high = frame_table_size / 2;
+	if(pageout_low > pageout_high)
+		pageout_low = pageout_high;
+	thread_create("pageout", PRI_DEFAULT, pageout_daemon, NULL);
+}
+
+void
+pageout_wake(void){
+	if(!pageout_waking){
+		pageout_waking = true;
+		sema_up(&pageout_sema);
+	}
+}
+
+static void
+pageout_daemon(void *aux UNUSED){
+	size_t free_cnt;
+	int n;
+
+	for(;;){
+		sema_down(&pageout_sema);
+		pageout_waking = false;
+		wake_cnt++;
+
+		n = swap_writeback_deferred();
+		pageout_cnt += n;
+
+		while(pageout_low > 0 && (free_cnt = frame_free_cnt()) < pageout_high){
+			n = swap_out_batch(pageout_high - free_cnt);
+			if(n == 0)
+				break;
+			batch_cnt++;
+			pageout_cnt += n;
+		}
+	}
+}
+
+void
+pageout_print_stats(void){
+	printf("Pageout: %lld wakeups, %lld frames evicted in %lld batches\n",
+			wake_cnt, pageout_cnt, batch_cnt);
+}
@@ -0,0 +1,15 @@
+#ifndef VM_PAGEOUT_H
+#define VM_PAGEOUT_H
+
+#include <stddef.h>
+
+// free user frames below which the page-out daemon starts evicting,
+// and up to which it keeps going.  set with -pageout=LOW:HIGH
+extern size_t pageout_low;
+extern size_t pageout_high;
+
+void pageout_init(void);
+void pageout_wake(void);
+void pageout_print_stats(void);
+
+#endif
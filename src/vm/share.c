@@ -0,0 +1,300 @@
+#include <stdio.h>
+#include <string.h>
+#include "vm/share.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "userprog/process.h"
+#include "filesys/file.h"
+#include "vm/swap.h"
+
+/*
+Read-only pages of an executable, keyed by (inode, offset,
+read_bytes).  Every process that runs the binary maps the same frame,
+and the frame is freed when the last mapping goes away or when it is
+evicted, which unmaps it from all of them at once.  Each entry holds
+its own reference to the inode: a process closes its executable
+before it tears down its page table, and without the reference the
+inode could be freed and its address reused by another binary while
+the entry still names it.  lock_share protects the table and the
+mapping lists.
+*/
+static struct hash share_table;
+static struct lock lock_share;
+
+// statistics
+static long long share_hit_cnt;			// mappings of an already loaded page
+static size_t shared_cnt;				// mappings beyond the first, right now
+static size_t max_shared_cnt;
+
+static unsigned
+share_hash_func(const struct hash_elem *e, void *aux UNUSED){
+	struct share_entry *s = hash_entry(e, struct share_entry, elem);
+
+	return hash_int((int) s->inode ^ s->offset ^ s->read_bytes);
+}
+
+static bool
+share_less_func(const struct hash_elem *a, const struct hash_elem *b,
+				void *aux UNUSED){
+	struct share_entry *s_a = hash_entry(a, struct share_entry, elem);
+	struct share_entry *s_b = hash_entry(b, struct share_entry, elem);
+
+	if(s_a->inode != s_b->inode)
+		return s_a->inode < s_b->inode;
+	if(s_a->offset != s_b->offset)
+		return s_a->offset < s_b->offset;
+	return s_a->read_bytes < s_b->read_bytes;
+}
+
+void
+share_init(void){
+	hash_init(&share_table, share_hash_func, share_less_func, NULL);
+	lock_init(&lock_share);
+}
+
+static struct share_entry *
+share_find(struct inode *inode, off_t offset, int read_bytes){
+	struct share_entry s;
+	struct hash_elem *e;
+
+	s.inode = inode;
+	s.offset = offset;
+	s.read_bytes = read_bytes;
+	e = hash_find(&share_table, &s.elem);
+
+	return e != NULL ? hash_entry(e, struct share_entry, elem) : NULL;
+}
+
+// adds PTE as a mapping of S; called with lock_share held
+static bool
+share_map(struct share_entry *s, struct page_table_entry *pte){
+	if(!install_page(pte->vaddr, s->frame->kaddr, false))
+		return false;
+
+	if(!list_empty(&s->ptes)){
+		share_hit_cnt++;
+		if(++shared_cnt > max_shared_cnt)
+			max_shared_cnt = shared_cnt;
+	}
+	list_push_back(&s->ptes, &pte->share_elem);
+	pte->share = s;
+	pte->frame = s->frame;
+	pte->loaded = true;
+	return true;
+}
+
+/*
+Maps the read-only file page PTE, reusing the frame of another
+process that already has it loaded.  Otherwise reads it into a new
+frame that later loads of the same page will share.
+*/
+bool
+share_load(struct page_table_entry *pte){
+	struct inode *inode = file_get_inode(pte->file);
+	struct share_entry *s;
+	struct frame *frame;
+	bool success;
+
+	lock_acquire(&lock_share);
+	s = share_find(inode, pte->offset, pte->read_bytes);
+	if(s != NULL){
+		success = share_map(s, pte);
+		lock_release(&lock_share);
+		return success;
+	}
+	lock_release(&lock_share);
+
+	// read the page without holding lock_share, since frame_alloc may evict
+	frame = page_frame_alloc();
+	if(frame == NULL)
+		return false;
+
+	if(file_read_at(pte->file, frame->kaddr, pte->read_bytes, pte->offset)
+			!= (int) pte->read_bytes){
+		frame_free(frame);
+		return false;
+	}
+	memset(frame->kaddr + pte->read_bytes, 0, pte->zero_bytes);
+
+	lock_acquire(&lock_share);
+	s = share_find(inode, pte->offset, pte->read_bytes);
+	if(s != NULL){
+		// someone else loaded it meanwhile
+		frame_free(frame);
+		success = share_map(s, pte);
+		lock_release(&lock_share);
+		return success;
+	}
+
+	s = malloc(sizeof *s);
+	if(s == NULL){
+		lock_release(&lock_share);
+		frame_free(frame);
+		return false;
+	}
+	s->inode = inode;
+	s->offset = pte->offset;
+	s->read_bytes = pte->read_bytes;
+	s->frame = frame;
+	list_init(&s->ptes);
+
+	if(!share_map(s, pte)){
+		lock_release(&lock_share);
+		frame_free(frame);
+		free(s);
+		return false;
+	}
+	inode_reopen(inode);
+	hash_insert(&share_table, &s->elem);
+	frame_to_table(frame, pte->vaddr);
+	lock_release(&lock_share);
+
+	return true;
+}
+
+/*
+Drops PTE's mapping of its shared frame, freeing the frame with the
+last one.  The caller clears PTE from its page directory.
+*/
+void
+share_release(struct page_table_entry *pte){
+	struct share_entry *s;
+	struct page_table_entry *next;
+	struct inode *inode = NULL;
+
+	lock_acquire(&lock_share);
+	s = pte->share;
+	if(s == NULL){
+		lock_release(&lock_share);
+		return;
+	}
+	list_remove(&pte->share_elem);
+	pte->share = NULL;
+	pte->frame = NULL;
+
+	if(list_empty(&s->ptes)){
+		hash_delete(&share_table, &s->elem);
+		frame_free(s->frame);
+		inode = s->inode;
+		free(s);
+	}
+	else{
+		shared_cnt--;
+		// the clock checks the owner's accessed bit, so hand it on
+		if(s->frame->thread == pte->thread){
+			next = list_entry(list_front(&s->ptes), struct page_table_entry, share_elem);
+			s->frame->thread = next->thread;
+		}
+	}
+	lock_release(&lock_share);
+
+	// closing may free the inode's sectors, so not under lock_share
+	inode_close(inode);
+}
+
+// returns true if a mapping of S before E belongs to thread T
+static bool
+share_seen(struct share_entry *s, struct list_elem *e, struct thread *t){
+	struct list_elem *i;
+
+	for(i = list_begin(&s->ptes); i != e; i = list_next(i))
+		if(list_entry(i, struct page_table_entry, share_elem)->thread == t)
+			return true;
+	return false;
+}
+
+// returns true if share_evict must lock the owner of the mapping E of
+// S, that is, if it is not PTE's owner and has not been locked already
+static bool
+share_must_lock(struct share_entry *s, struct page_table_entry *pte,
+				struct list_elem *e){
+	struct thread *t = list_entry(e, struct page_table_entry, share_elem)->thread;
+
+	return t != pte->thread && !share_seen(s, e, t);
+}
+
+// releases the page table locks share_evict took for the mappings
+// of S before STOP
+static void
+share_unlock(struct share_entry *s, struct page_table_entry *pte,
+				struct list_elem *stop){
+	struct list_elem *e;
+
+	for(e = list_begin(&s->ptes); e != stop; e = list_next(e))
+		if(share_must_lock(s, pte, e))
+			lock_release(&list_entry(e, struct page_table_entry, share_elem)
+					->thread->page_table_lock);
+}
+
+/*
+Evicts the shared frame mapped by PTE from every process and returns
+true.  The page is read-only, so it is simply read again on the next
+fault.  The caller holds the page_table_lock of PTE's owner; those of
+the other mappings' owners are only tried, as frame_claim does, and
+if one is busy or its page is still being faulted in nothing is
+evicted and this returns false.
+*/
+bool
+share_evict(struct page_table_entry *pte){
+	struct share_entry *s;
+	struct page_table_entry *p;
+	struct list_elem *e;
+	struct inode *inode;
+	struct lock *l;
+	bool busy;
+
+	lock_acquire(&lock_share);
+	s = pte->share;
+	if(s == NULL){
+		lock_release(&lock_share);
+		return false;
+	}
+	busy = false;
+	for(e = list_begin(&s->ptes); e != list_end(&s->ptes); e = list_next(e)){
+		p = list_entry(e, struct page_table_entry, share_elem);
+		l = &p->thread->page_table_lock;
+		if(share_must_lock(s, pte, e)
+				&& (lock_held_by_current_thread(l) || !lock_try_acquire(l))){
+			busy = true;
+			break;
+		}
+		if(p->in_transit){
+			busy = true;
+			e = list_next(e);
+			break;
+		}
+	}
+	if(busy){
+		share_unlock(s, pte, e);
+		lock_release(&lock_share);
+		return false;
+	}
+
+	for(e = list_begin(&s->ptes); e != list_end(&s->ptes); e = list_next(e)){
+		p = list_entry(e, struct page_table_entry, share_elem);
+		pagedir_clear_page(p->thread->pagedir, p->vaddr);
+		p->share = NULL;
+		p->frame = NULL;
+		p->loaded = false;
+	}
+	share_unlock(s, pte, list_end(&s->ptes));
+	shared_cnt -= list_size(&s->ptes) - 1;
+
+	hash_delete(&share_table, &s->elem);
+	frame_free(s->frame);
+	inode = s->inode;
+	free(s);
+	lock_release(&lock_share);
+
+	inode_close(inode);
+	return true;
+}
+
+void
+share_print_stats(void){
+	printf("Sharing: %lld mappings of loaded executable pages, "
+			"%zu kB saved at most\n",
+			share_hit_cnt, max_shared_cnt * PGSIZE / 1024);
+}
@@ -0,0 +1,28 @@
+#ifndef VM_SHARE_H
+#define VM_SHARE_H
+
+#include <hash.h>
+#include <list.h>
+#include "filesys/inode.h"
+#include "filesys/off_t.h"
+#include "vm/frame.h"
+#include "vm/page.h"
+
+// a read-only executable page mapped by every process running the binary
+struct share_entry{
+	struct inode *inode;		// reopened, so it outlives the executable's file
+	off_t offset;
+	int read_bytes;				// the rest of the page is zeroed
+	struct frame *frame;
+	struct list ptes;			// page_table_entry.share_elem of every mapping
+
+	struct hash_elem elem;
+};
+
+void share_init(void);
+bool share_load(struct page_table_entry *pte);
+void share_release(struct page_table_entry *pte);
+bool share_evict(struct page_table_entry *pte);
+void share_print_stats(void);
+
+#endif
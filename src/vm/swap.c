@@ -2,143 +2,423 @@
 #include "vm/swap.h"
 #include "vm/frame.h"
 #include "vm/page.h"
+#include "vm/share.h"
+#include "vm/zswap.h"
+#include "vm/pageout.h"
 #include "threads/palloc.h"
 #include "userprog/process.h"
 #include "userprog/pagedir.h"
-
+#include "filesys/filesys.h"
+#include "filesys/file.h"
+
+/*
+Disk used for swap, hd1:1 by default.  The -swap=CHANNEL:DEVICE
+kernel option moves it, e.g. onto the other channel from the file
+system so that swap and file I/O overlap.
+*/
+int swap_channel = 1;
+int swap_device = 1;
+
+// eviction statistics
+static long long swap_out_cnt;
+static long long swap_discard_cnt;
+static long long swap_writeback_cnt;
+
+/*
+Dirty mmap pages that swap_out picks are written back by the page-out
+daemon, not by the faulting thread: that thread may be inside
+inode_read_at or inode_write_at, holding the inode's rw lock while it
+copies to or from the user buffer that faulted, and file_write_at
+would take an inode rw lock again.  The frames wait on writeback_list,
+already unmapped and in transit, until the daemon finishes them.
+*/
+static struct list writeback_list;
+static struct lock lock_writeback;
+static struct condition writeback_cond;	// broadcast as writeback_done grows
+static int writeback_queued;			// deferred and not yet freed
+static long long writeback_done;		// deferred and freed
 
 void
 swap_init(){
-	swap_disk = disk_get(1,1);
+	swap_disk = disk_get(swap_channel, swap_device);
+	if(swap_disk == NULL)
+		PANIC("no swap disk at hd%d:%d", swap_channel, swap_device);
+	if(swap_channel == 0 && swap_device == 0)
+		PANIC("swap disk hd0:0 holds the kernel");
+	if(swap_disk == filesys_disk)
+		PANIC("swap disk hd%d:%d holds the file system", swap_channel, swap_device);
 	swap_table = bitmap_create(disk_size(swap_disk));
+	if(disk_size(swap_disk) >= ZSWAP_BASE)
+		PANIC("swap disk hd%d:%d is too large", swap_channel, swap_device);
+	zswap_init();
 	lock_init(&lock_swap);
+	list_init(&writeback_list);
+	lock_init(&lock_writeback);
+	cond_init(&writeback_cond);
 }
 
-int
-swap_add(void *kaddr){
-	int i;
+/*
+Slots from ZSWAP_BASE up are pages kept compressed in memory by
+vm/zswap.c; swap_add tries there first and the disk only if the page
+does not compress or the memory pool is full.  A disk write is only
+started with REQ, and *PENDING set; the caller must disk_wait(REQ)
+before touching KADDR again or reading the slot.
+*/
+static int
+swap_add_start(void *kaddr, struct disk_request *req, bool *pending){
 	int swap_table_index;
 
-	//lock_acquire(&lock_swap);
+	*pending = false;
+	lock_acquire(&lock_swap);
+	swap_table_index = zswap_store(kaddr);
+	if(swap_table_index != -1){
+		lock_release(&lock_swap);
+		return ZSWAP_BASE + swap_table_index;
+	}
+
 	swap_table_index = bitmap_scan_and_flip(swap_table, 0, DISK_SECTOR_NUMBER, false);
+	lock_release(&lock_swap);
 
 	if(swap_table_index == BITMAP_ERROR){
 		printf("swap_table_index - BITMAP_ERROR\n");
 		return -2;
 	}
 
-	for(i=0; i<DISK_SECTOR_NUMBER; i++){
-		disk_write(swap_disk, swap_table_index + i, kaddr + i*DISK_SECTOR_SIZE);
-	}
-	//lock_release(&lock_swap);
+	disk_request_init(req, swap_disk, swap_table_index, DISK_SECTOR_NUMBER, kaddr, true);
+	disk_submit(req);
+	*pending = true;
 
 	return swap_table_index;
 }
 
-void
-swap_delete(void *kaddr, int swap_table_index){
-	int i;
+int
+swap_add(void *kaddr){
+	struct disk_request req;
+	bool pending;
+	int swap_table_index;
 
-	lock_acquire(&lock_swap);
-	for(i=0; i<DISK_SECTOR_NUMBER; i++){
-		disk_read(swap_disk, swap_table_index + i, kaddr + i*DISK_SECTOR_SIZE);
-	}
+	swap_table_index = swap_add_start(kaddr, &req, &pending);
+	if(pending)
+		disk_wait(&req);
 
-	bitmap_set_multiple(swap_table, swap_table_index, DISK_SECTOR_NUMBER, false);
-	lock_release(&lock_swap);
+	return swap_table_index;
+}
 
-	return -1;
+/*
+Reads the page in swap slot SWAP_TABLE_INDEX into KADDR, keeping
+the slot.
+*/
+void
+swap_read(void *kaddr, int swap_table_index){
+	if(swap_table_index >= ZSWAP_BASE){
+		lock_acquire(&lock_swap);
+		zswap_load(swap_table_index - ZSWAP_BASE, kaddr);
+		lock_release(&lock_swap);
+	}
+	else
+		disk_read_multiple(swap_disk, swap_table_index, DISK_SECTOR_NUMBER, kaddr);
+}
+
+/*
+Reads the page in swap slot SWAP_TABLE_INDEX into KADDR and frees
+the slot.  The disk read runs without lock_swap; the PTE that owns
+the slot is in transit meanwhile, so nobody else touches the slot.
+*/
+void
+swap_delete(void *kaddr, int swap_table_index){
+	if(swap_table_index >= ZSWAP_BASE){
+		lock_acquire(&lock_swap);
+		zswap_load(swap_table_index - ZSWAP_BASE, kaddr);
+		zswap_free(swap_table_index - ZSWAP_BASE);
+		lock_release(&lock_swap);
+	}
+	else{
+		disk_read_multiple(swap_disk, swap_table_index, DISK_SECTOR_NUMBER, kaddr);
+		lock_acquire(&lock_swap);
+		bitmap_set_multiple(swap_table, swap_table_index, DISK_SECTOR_NUMBER, false);
+		lock_release(&lock_swap);
+	}
 }
 
 void
 swap_free(int swap_table_index){
 	lock_acquire(&lock_swap);
-	bitmap_set_multiple(swap_table, swap_table_index, DISK_SECTOR_NUMBER, false);
+	if(swap_table_index >= ZSWAP_BASE)
+		zswap_free(swap_table_index - ZSWAP_BASE);
+	else
+		bitmap_set_multiple(swap_table, swap_table_index, DISK_SECTOR_NUMBER, false);
 	lock_release(&lock_swap);
 }
 
+/*
+Brings PTE, which the caller has marked in transit, back from swap.
+*/
 bool
 swap_in(struct page_table_entry *pte){
-
 	struct frame *frame;
-	bool success = false;
 
 	if(pte->swap_table_index == -1){
 		//printf("swap_in - swap_table_index = -1\n");
 		return false;
 	}
 
-	frame = frame_alloc();
-
-	if(frame == NULL){
-    	//printf("swap_in - swap_out\n");
-    	if(swap_out()){
-          frame = frame_alloc();
-        }
-        else{
-          return false;
-        }
-  	}
+	frame = page_frame_alloc();
+	if(frame == NULL)
+		return false;
 
-  	swap_delete(frame->kaddr, pte->swap_table_index);
+	swap_delete(frame->kaddr, pte->swap_table_index);
 	pte->swap_table_index = -1;
 
+	// the frame goes to the page table even if the mapping fails, so
+	// that process_exit frees it
+	pte->frame = frame;
 	frame_to_table(frame, pte->vaddr);
 
-	pte->frame = frame;
-	success = install_page(pte->vaddr, frame->kaddr, pte->writable);
-      if(!success){
-      	page_table_delete(pte);
-      	return false;
-      }
-    //printf("swap_in - success = %d\n", success);
-	
-	return true;
+	return install_page(pte->vaddr, frame->kaddr, pte->writable);
 }
 
-bool
-swap_out(){
+/*
+Writes a dirty mmap page back to its file.
+*/
+static void
+swap_write_back(struct page_table_entry *pte, void *kaddr){
+	if(file_write_at(pte->file, kaddr, pte->read_bytes, pte->offset)
+			!= (int) pte->read_bytes)
+		printf("swap_out - mmap didn't write\n");
+}
+
+// a frame on its way out
+struct eviction{
+	struct frame *frame;
+	struct page_table_entry *pte;		// in transit until evict_finish
+	struct thread *thread;				// owner of PTE
+	struct disk_request req;			// swap write, if PENDING
+	bool pending;
+	bool write_back;					// dirty mmap page to write to its file
+};
+
+/*
+Evicts one frame.  Clean file pages (executable or mmap) are dropped
+and read again from the file on the next fault, dirty mmap pages go
+back to their file, and everything else goes to swap.  A file page
+dirtied in memory no longer matches the file, so it is swapped from
+then on like an anonymous page.
+
+The victim's PTE is updated under its owner's page_table_lock and
+left in transit; the writes happen in evict_finish without any lock,
+and the owner's faults on the page wait until then.
+*/
+static bool
+evict_start(struct eviction *ev){
 	struct frame *victim_frame;
 	struct page_table_entry *victim_pte;
+	struct thread *t;
 	int swap_table_index;
-	
-	lock_acquire(&lock_swap);
+	int tries;
+	bool dirty, evicted;
+
+	ev->frame = NULL;
+	ev->pending = false;
+	ev->write_back = false;
+
+	for(tries = 0; ; tries++){
+		// returns with the owner's page_table_lock held
+		victim_frame = frame_replacement_select();
+		if(victim_frame == NULL)
+			return false;
+		t = victim_frame->thread;
+		victim_pte = page_table_find(victim_frame->vaddr, t);
+
+		// read-only executable pages and pages shared since fork may be
+		// mapped by several processes, and if one of them is busy another
+		// victim is picked.  only the owner could add to cow_ptes, so an
+		// empty list stays empty
+		if(victim_pte->share != NULL){
+			evicted = share_evict(victim_pte);
+			if(evicted)
+				swap_discard_cnt++;
+		}
+		else if(!list_empty(&victim_frame->cow_ptes))
+			evicted = page_cow_evict(victim_frame);
+		else
+			break;
+		lock_release(&t->page_table_lock);
+		if(evicted)
+			return true;
+		if(tries == SWAP_BATCH_MAX)
+			return false;
+	}
 
-	victim_frame = frame_replacement_select();
+	// unmap first so the owner cannot dirty the page behind our back;
+	// the dirty bit survives in the not-present PTE
+	pagedir_clear_page(t->pagedir, victim_frame->vaddr);
+	dirty = pagedir_is_dirty(t->pagedir, victim_frame->vaddr);
+
+	if(victim_pte->type == PTE_MMAP){
+		if(dirty){
+			ev->write_back = true;
+			swap_writeback_cnt++;
+		}
+		else
+			swap_discard_cnt++;
+		victim_pte->loaded = false;
+	}
+	else if(victim_pte->type == PTE_FILE && !dirty){
+		victim_pte->loaded = false;
+		swap_discard_cnt++;
+	}
+	else{
+		swap_table_index = swap_add_start(victim_frame->kaddr, &ev->req, &ev->pending);
+
+		if(swap_table_index == -2){
+			printf("swap_out BITMAP_ERROR\n");
+			pagedir_set_page(t->pagedir, victim_frame->vaddr,
+					victim_frame->kaddr, victim_pte->writable);
+			lock_release(&t->page_table_lock);
+			return false;
+		}
+
+		victim_pte->type = PTE_FRAME;
+		victim_pte->swap_table_index = swap_table_index;
+		swap_out_cnt++;
+	}
 
-	//if(victim_frame->filename)
-	//	printf("swap_out victim_frame filename = %d\n", victim_frame->filename);
+	victim_pte->frame = NULL;
+	victim_pte->cow = false;
+	victim_pte->in_transit = true;
+	lock_release(&t->page_table_lock);
 
-	if(victim_frame == NULL){
-		printf("NULL FRAME\n");
-		return false;
-	} 
+	ev->frame = victim_frame;
+	ev->pte = victim_pte;
+	ev->thread = t;
 
-	victim_pte = page_table_find(victim_frame->vaddr, victim_frame->thread);
-	if(victim_pte == NULL){
-		printf("NULL PTE\n");
-		return false;
+	return true;
+}
+
+static void
+evict_finish(struct eviction *ev){
+	struct thread *t = ev->thread;
+
+	if(ev->frame == NULL)
+		return;
+
+	if(ev->write_back)
+		swap_write_back(ev->pte, ev->frame->kaddr);
+	if(ev->pending)
+		disk_wait(&ev->req);
+
+	lock_acquire(&t->page_table_lock);
+	ev->pte->in_transit = false;
+	cond_broadcast(&t->page_transit, &t->page_table_lock);
+	lock_release(&t->page_table_lock);
+
+	frame_free(ev->frame);
+}
+
+// hands EV's write-back to the page-out daemon
+static void
+writeback_defer(struct eviction *ev){
+	lock_acquire(&lock_writeback);
+	list_push_back(&writeback_list, &ev->frame->writeback_elem);
+	writeback_queued++;
+	lock_release(&lock_writeback);
+	pageout_wake();
+}
+
+/*
+Evicts one frame for a faulting thread.  Dirty mmap victims go to the
+page-out daemon and another victim is picked; if there is none, this
+waits until the daemon has freed a deferred frame.
+*/
+bool
+swap_out(){
+	struct eviction ev;
+	long long done;
+	int deferred = 0;
+	bool success;
+
+	lock_acquire(&lock_writeback);
+	done = writeback_done;
+	lock_release(&lock_writeback);
+
+	while(deferred < SWAP_BATCH_MAX && evict_start(&ev)){
+		if(!ev.write_back){
+			evict_finish(&ev);
+			return true;
+		}
+		writeback_defer(&ev);
+		deferred++;
 	}
 
-	swap_table_index = swap_add(victim_frame->kaddr);
+	lock_acquire(&lock_writeback);
+	while(writeback_done == done && writeback_queued > 0)
+		cond_wait(&writeback_cond, &lock_writeback);
+	success = writeback_done != done;
+	lock_release(&lock_writeback);
 
-	//printf("swap out type = %d\n", (int)victim_pte->type);
+	return success;
+}
 
-	if(swap_table_index == -2){
-		printf("swap_out BITMAP_ERROR\n");
-		return false;
+/*
+Writes back and frees the frames swap_out deferred.  Only the page-out
+daemon calls this.  Returns the number of frames freed.
+*/
+int
+swap_writeback_deferred(void){
+	struct eviction ev;
+	struct frame *f;
+	int n = 0;
+
+	lock_acquire(&lock_writeback);
+	while(!list_empty(&writeback_list)){
+		f = list_entry(list_pop_front(&writeback_list), struct frame, writeback_elem);
+		lock_release(&lock_writeback);
+
+		ev.frame = f;
+		ev.thread = f->thread;
+		ev.pending = false;
+		ev.write_back = true;
+		lock_acquire(&ev.thread->page_table_lock);
+		ev.pte = page_table_find(f->vaddr, ev.thread);
+		lock_release(&ev.thread->page_table_lock);
+		evict_finish(&ev);
+		n++;
+
+		lock_acquire(&lock_writeback);
+		writeback_queued--;
+		writeback_done++;
+		cond_broadcast(&writeback_cond, &lock_writeback);
 	}
+	lock_release(&lock_writeback);
 
-	victim_pte->swap_table_index = swap_table_index;
-	victim_pte->frame = NULL;
-	//printf("swaped out vaddr = %x kaddr = %x\n", victim_pte->vaddr, victim_frame->kaddr);
-	pagedir_clear_page(victim_frame->thread->pagedir, victim_frame->vaddr);
+	return n;
+}
 
+/*
+Evicts up to CNT frames, starting all their swap writes before
+waiting for any, so that the disk queue can merge and order them.
+Returns the number of frames evicted.
+*/
+int
+swap_out_batch(int cnt){
+	struct eviction ev[SWAP_BATCH_MAX];
+	int i, n;
 
-	frame_free(victim_frame);
+	if(cnt > SWAP_BATCH_MAX)
+		cnt = SWAP_BATCH_MAX;
 
-	lock_release(&lock_swap);
+	for(n = 0; n < cnt; n++)
+		if(!evict_start(&ev[n]))
+			break;
+	for(i = 0; i < n; i++)
+		evict_finish(&ev[i]);
 
-	//printf("swaped out vaddr = %x\n", victim_pte->vaddr);
-	return true;
-}
\ No newline at end of file
+	return n;
+}
+
+void
+swap_print_stats(void){
+	printf("Swap: %lld pages swapped out, %lld clean file pages dropped, "
+			"%lld mmap pages written back\n",
+			swap_out_cnt, swap_discard_cnt, swap_writeback_cnt);
+}
@@ -8,16 +8,26 @@
 
 #define DISK_SECTOR_NUMBER 8
 
+// most frames swap_out_batch evicts at once
+#define SWAP_BATCH_MAX 16
+
 struct bitmap *swap_table;
 struct disk *swap_disk;
 
 struct lock lock_swap;
 
+extern int swap_channel;
+extern int swap_device;
+
 void swap_init(void);
 int swap_add(void *kaddr);
+void swap_read(void *kaddr, int swap_table_index);
 void swap_delete(void *kaddr, int swap_table_index);
 void swap_free(int swap_table_index);
 bool swap_in(struct page_table_entry *pte);
 bool swap_out(void);
+int swap_out_batch(int cnt);
+int swap_writeback_deferred(void);
+void swap_print_stats(void);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,181 @@
+#include <bitmap.h>
+#include <debug.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "vm/zswap.h"
+#include "threads/malloc.h"
+#include "threads/vaddr.h"
+
+/*
+Compressed swap held in kernel memory, tried before the swap disk.
+A page whose words are all the same (most often all zero) is kept as
+that one word.  Any other page is compressed by runs of zero words:
+the output is a sequence of records, each a header word holding the
+number of zero words to skip (low half) and of literal words that
+follow (high half), then the literal words.  Pages that do not shrink
+to half a page, or that do not fit in the pool, go to disk.
+
+The caller holds lock_swap.
+*/
+
+#define ZSWAP_SLOTS 1024				// pages the pool can hold
+#define ZSWAP_MAX_BYTES (256 * 1024)	// compressed bytes the pool can hold
+#define PAGE_WORDS (PGSIZE / sizeof(uint32_t))
+#define ZSWAP_MAX_SIZE (PGSIZE / 2)		// largest compressed page kept
+
+struct zslot{
+	uint32_t fill;			// every word of the page, if DATA is null
+	uint8_t *data;			// compressed page
+	size_t size;			// bytes in DATA
+};
+
+static struct zslot zslots[ZSWAP_SLOTS];
+static struct bitmap *zslot_map;
+static size_t zswap_bytes;
+
+static uint32_t zbuf[ZSWAP_MAX_SIZE / sizeof(uint32_t)];
+
+// statistics
+static long long store_cnt;			// pages kept in memory
+static long long same_cnt;			// ... of which same-filled
+static long long spill_cnt;			// pages sent on to disk
+static long long load_cnt;			// pages read back from memory
+static long long bytes_in;			// page bytes stored
+static long long bytes_out;			// compressed bytes they took
+
+void
+zswap_init(void){
+	zslot_map = bitmap_create(ZSWAP_SLOTS);
+	if(zslot_map == NULL)
+		PANIC("zswap_init - bitmap_create failed");
+}
+
+// returns the word every word of PAGE equals, in *FILL, if any
+static bool
+same_filled(const uint32_t *page, uint32_t *fill){
+	size_t i;
+
+	for(i = 1; i < PAGE_WORDS; i++)
+		if(page[i] != page[0])
+			return false;
+	*fill = page[0];
+	return true;
+}
+
+// compresses PAGE into zbuf; returns the size, or 0 if it does not fit
+static size_t
+compress(const uint32_t *page){
+	size_t in = 0, out = 0;
+	size_t zeros, lits;
+
+	while(in < PAGE_WORDS){
+		for(zeros = 0; in < PAGE_WORDS && page[in] == 0; in++)
+			zeros++;
+		for(lits = 0; in + lits < PAGE_WORDS && page[in + lits] != 0; lits++)
+			continue;
+		if(out + 1 + lits > ZSWAP_MAX_SIZE / sizeof(uint32_t))
+			return 0;
+		zbuf[out++] = zeros | (lits << 16);
+		memcpy(&zbuf[out], &page[in], lits * sizeof(uint32_t));
+		out += lits;
+		in += lits;
+	}
+	return out * sizeof(uint32_t);
+}
+
+static void
+decompress(const uint32_t *data, size_t size, uint32_t *page){
+	const uint32_t *end = data + size / sizeof(uint32_t);
+	size_t zeros, lits;
+
+	while(data < end){
+		zeros = *data & 0xffff;
+		lits = *data++ >> 16;
+		memset(page, 0, zeros * sizeof(uint32_t));
+		page += zeros;
+		memcpy(page, data, lits * sizeof(uint32_t));
+		page += lits;
+		data += lits;
+	}
+}
+
+/*
+Keeps the page at KADDR in memory if it compresses well and there
+is room.  Returns its slot, or -1 if it must go to disk.
+*/
+int
+zswap_store(const void *kaddr){
+	struct zslot *z;
+	uint32_t fill = 0;
+	size_t slot, size = 0;
+	uint8_t *data = NULL;
+
+	if(!same_filled(kaddr, &fill)){
+		size = compress(kaddr);
+		if(size == 0 || zswap_bytes + size > ZSWAP_MAX_BYTES)
+			goto spill;
+		data = malloc(size);
+		if(data == NULL)
+			goto spill;
+		memcpy(data, zbuf, size);
+	}
+
+	slot = bitmap_scan_and_flip(zslot_map, 0, 1, false);
+	if(slot == BITMAP_ERROR){
+		free(data);
+		goto spill;
+	}
+
+	z = &zslots[slot];
+	z->fill = fill;
+	z->data = data;
+	z->size = size;
+	zswap_bytes += size;
+
+	store_cnt++;
+	if(data == NULL)
+		same_cnt++;
+	bytes_in += PGSIZE;
+	bytes_out += size;
+	return slot;
+
+ spill:
+	spill_cnt++;
+	return -1;
+}
+
+// reads the page in SLOT into KADDR
+void
+zswap_load(int slot, void *kaddr){
+	struct zslot *z = &zslots[slot];
+	uint32_t *page = kaddr;
+	size_t i;
+
+	ASSERT(bitmap_test(zslot_map, slot));
+	if(z->data == NULL)
+		for(i = 0; i < PAGE_WORDS; i++)
+			page[i] = z->fill;
+	else
+		decompress((uint32_t *) z->data, z->size, page);
+	load_cnt++;
+}
+
+void
+zswap_free(int slot){
+	struct zslot *z = &zslots[slot];
+
+	ASSERT(bitmap_test(zslot_map, slot));
+	free(z->data);
+	zswap_bytes -= z->size;
+	bitmap_reset(zslot_map, slot);
+}
+
+void
+zswap_print_stats(void){
+	printf("Zswap: %lld pages kept (%lld same-filled), %lld sent to disk, "
+			"%lld read back, %lld kB stored in %lld kB (%lld%%)\n",
+			store_cnt, same_cnt, spill_cnt, load_cnt,
+			bytes_in / 1024, bytes_out / 1024,
+			bytes_in > 0 ? bytes_out * 100 / bytes_in : 0);
+}
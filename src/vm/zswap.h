@@ -0,0 +1,15 @@
+#ifndef VM_ZSWAP_H
+#define VM_ZSWAP_H
+
+#include <stdbool.h>
+
+// swap_table_index of memory slot 0; disk slots are all below it
+#define ZSWAP_BASE (1 << 30)
+
+void zswap_init(void);
+int zswap_store(const void *kaddr);
+void zswap_load(int slot, void *kaddr);
+void zswap_free(int slot);
+void zswap_print_stats(void);
+
+#endif